@@ -0,0 +1,284 @@
+#include "cfs.h"
+#include "defs.h"
+#include "stridequeue.h"
+#include "thread.h"
+
+/* Every runnable process should run once in this many ticks,
+ * but once picked it runs at least CFS_MINSLICE. */
+const int CFS_LATENCY = 8;
+const int CFS_MINSLICE = 1;
+
+/* Weight of each nice level, from -20 to 19.
+ * One level apart is about 10% of the cpu, as in Linux. */
+static const int niceWeight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+#define NICE0_WEIGHT 1024
+
+/* CFS is initialized in InitMLFQ() */
+void InitCFS(struct CFS* cfs){
+	cfs->root = 0;
+	cfs->nready = 0;
+	cfs->weight = 0;
+	cfs->minVruntime = 0;
+}
+
+/* AVL tree, linked through pp->cfsLeft and pp->cfsRight.
+ * Ties in cfsKey are broken by address, so keys are unique. */
+
+static int Height(struct procParse* pp){
+	return pp != 0 ? pp->cfsHeight : 0;
+}
+
+static void UpdateHeight(struct procParse* pp){
+	int l = Height(pp->cfsLeft);
+	int r = Height(pp->cfsRight);
+
+	pp->cfsHeight = (l > r ? l : r) + 1;
+}
+
+static int KeyBefore(struct procParse* a, struct procParse* b){
+	if (a->cfsKey != b->cfsKey) {
+		return PASSBEFORE(a->cfsKey, b->cfsKey);
+	}
+	return a < b;
+}
+
+static struct procParse* RotateRight(struct procParse* y){
+	struct procParse* x = y->cfsLeft;
+
+	y->cfsLeft = x->cfsRight;
+	x->cfsRight = y;
+	UpdateHeight(y);
+	UpdateHeight(x);
+	return x;
+}
+
+static struct procParse* RotateLeft(struct procParse* x){
+	struct procParse* y = x->cfsRight;
+
+	x->cfsRight = y->cfsLeft;
+	y->cfsLeft = x;
+	UpdateHeight(x);
+	UpdateHeight(y);
+	return y;
+}
+
+/* Rebalance the subtree at pp after one insertion or removal below.
+ * Returns its new root. */
+static struct procParse* Balance(struct procParse* pp){
+	int diff;
+
+	UpdateHeight(pp);
+	diff = Height(pp->cfsLeft) - Height(pp->cfsRight);
+
+	if (diff > 1) {
+		if (Height(pp->cfsLeft->cfsLeft) < Height(pp->cfsLeft->cfsRight)) {
+			pp->cfsLeft = RotateLeft(pp->cfsLeft);
+		}
+		return RotateRight(pp);
+	}
+	if (diff < -1) {
+		if (Height(pp->cfsRight->cfsRight) < Height(pp->cfsRight->cfsLeft)) {
+			pp->cfsRight = RotateRight(pp->cfsRight);
+		}
+		return RotateLeft(pp);
+	}
+	return pp;
+}
+
+/* The tree holds NPROC at most, so recursion is a few levels deep */
+static struct procParse* TreeInsert(struct procParse* root,
+									struct procParse* pp){
+	if (root == 0) {
+		pp->cfsLeft = pp->cfsRight = 0;
+		pp->cfsHeight = 1;
+		return pp;
+	}
+
+	if (KeyBefore(pp, root)) {
+		root->cfsLeft = TreeInsert(root->cfsLeft, pp);
+	}
+	else {
+		root->cfsRight = TreeInsert(root->cfsRight, pp);
+	}
+	return Balance(root);
+}
+
+static struct procParse* TreeRemoveMin(struct procParse* root,
+									   struct procParse** min){
+	if (root->cfsLeft == 0) {
+		*min = root;
+		return root->cfsRight;
+	}
+
+	root->cfsLeft = TreeRemoveMin(root->cfsLeft, min);
+	return Balance(root);
+}
+
+static struct procParse* TreeRemove(struct procParse* root,
+									struct procParse* pp){
+	struct procParse* next;
+	struct procParse* right;
+
+	if (root == 0) {
+		panic("TreeRemove: not in the tree");
+	}
+
+	if (root == pp) {
+		if (pp->cfsLeft == 0) {
+			return pp->cfsRight;
+		}
+		if (pp->cfsRight == 0) {
+			return pp->cfsLeft;
+		}
+
+		/* Its successor takes its place */
+		right = TreeRemoveMin(pp->cfsRight, &next);
+		next->cfsLeft = pp->cfsLeft;
+		next->cfsRight = right;
+		return Balance(next);
+	}
+
+	if (KeyBefore(pp, root)) {
+		root->cfsLeft = TreeRemove(root->cfsLeft, pp);
+	}
+	else {
+		root->cfsRight = TreeRemove(root->cfsRight, pp);
+	}
+	return Balance(root);
+}
+
+/* Put pp in the tree by its vruntime now */
+static void Enqueue(struct CFS* cfs, struct procParse* pp){
+	pp->cfsKey = pp->vruntime;
+	pp->cfsWeight = niceWeight[pp->nice - NICE_MIN];
+	cfs->root = TreeInsert(cfs->root, pp);
+	cfs->nready++;
+	cfs->weight += pp->cfsWeight;
+}
+
+static void Dequeue(struct CFS* cfs, struct procParse* pp){
+	cfs->root = TreeRemove(cfs->root, pp);
+	pp->cfsHeight = 0;
+	cfs->nready--;
+	cfs->weight -= pp->cfsWeight;
+}
+
+/* A process joining starts at the lowest vruntime, not below.
+ * Otherwise a new process would run until it caught up. */
+void InsertCFS(struct CFS* cfs, struct procParse* pp){
+	if (PASSBEFORE(pp->vruntime, cfs->minVruntime)) {
+		pp->vruntime = cfs->minVruntime;
+	}
+
+	pp->inCFS = 1;
+	pp->cfsHeight = 0;
+	if (pp->nrunnable > 0) {
+		Enqueue(cfs, pp);
+	}
+}
+
+int RemoveCFS(struct CFS* cfs, struct procParse* pp){
+	if (!pp->inCFS) {
+		return 0;
+	}
+
+	if (pp->cfsHeight != 0) {
+		Dequeue(cfs, pp);
+	}
+	pp->inCFS = 0;
+	return 1;
+}
+
+/* A process waking up is placed at most half the target latency
+ * behind the lowest vruntime. It runs soon, but sleeping long does
+ * not bank cpu time. */
+void RequeueCFS(struct CFS* cfs, struct procParse* pp){
+	uint64 floor;
+
+	if (!pp->inCFS) {
+		return; // Not in CFS
+	}
+
+	if (pp->nrunnable == 0) {
+		if (pp->cfsHeight != 0) {
+			Dequeue(cfs, pp);
+		}
+		return;
+	}
+
+	if (pp->cfsHeight == 0) {
+		floor = cfs->minVruntime - (uint64)(CFS_LATENCY * STRIDE1 / 2);
+		if (PASSBEFORE(pp->vruntime, floor)) {
+			pp->vruntime = floor;
+		}
+		Enqueue(cfs, pp);
+	}
+}
+
+static struct procParse* Leftmost(struct procParse* pp){
+	while (pp != 0 && pp->cfsLeft != 0) {
+		pp = pp->cfsLeft;
+	}
+	return pp;
+}
+
+/* First process of the tree in vruntime order that may run on cpu */
+static struct procParse* FirstOn(struct procParse* root, int cpu){
+	struct procParse* pp;
+
+	if (root == 0) {
+		return 0;
+	}
+	if ((pp = FirstOn(root->cfsLeft, cpu)) != 0) {
+		return pp;
+	}
+	if (RunnableOn(root, cpu)) {
+		return root;
+	}
+	return FirstOn(root->cfsRight, cpu);
+}
+
+struct procParse* SearchCFS(struct CFS* cfs, int cpu){
+	struct procParse* pp;
+
+	/* A process whose other lwps ran stays in the tree meanwhile.
+	 * Sort it by its vruntime now before picking it. */
+	while ((pp = Leftmost(cfs->root)) != 0 && pp->cfsKey != pp->vruntime) {
+		Dequeue(cfs, pp);
+		Enqueue(cfs, pp);
+	}
+	if (pp == 0) {
+		return 0;
+	}
+
+	if (PASSBEFORE(cfs->minVruntime, pp->vruntime)) {
+		cfs->minVruntime = pp->vruntime;
+	}
+
+	/* The lowest may be pinned to other cpus */
+	if (!RunnableOn(pp, cpu) && (pp = FirstOn(cfs->root, cpu)) == 0) {
+		return 0;
+	}
+
+	/* Its slice of the target latency, by weight */
+	pp->cfsSlice = CFS_LATENCY * pp->cfsWeight / cfs->weight;
+	if (pp->cfsSlice < CFS_MINSLICE) {
+		pp->cfsSlice = CFS_MINSLICE;
+	}
+	pp->usedQuantumTick = 0;
+
+	return pp;
+}
+
+void ChargeCFS(struct procParse* pp){
+	pp->vruntime += (uint)(STRIDE1 * NICE0_WEIGHT) / niceWeight[pp->nice - NICE_MIN];
+}
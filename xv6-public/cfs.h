@@ -0,0 +1,41 @@
+#ifndef CFS_H
+#define CFS_H
+
+#include "procparse.h"
+
+/* Completely fair time-sharing class, built instead of MLFQ's level
+ * queues with make SCHED=cfs. Processes with a RUNNABLE lwp are kept
+ * in an AVL tree by virtual runtime, the lowest is picked. A tick
+ * advances vruntime by STRIDE1 for nice 0, less for a lower nice.
+ * Like MLFQ, the class as a whole competes with the stride scheduler
+ * by the MLFQ's pass. */
+struct CFS {
+	struct procParse* root; // Tree of processes with a RUNNABLE lwp
+	int nready; // Processes in the tree
+	int weight; // Sum of their weights
+	uint64 minVruntime; // Lowest vruntime picked, only moves forward
+};
+
+/* Nice levels range from -20 to 19 */
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+
+void InitCFS(struct CFS* cfs);
+
+/* pp joins or leaves the class.
+ * RemoveCFS returns 0 if pp was not in it. */
+void InsertCFS(struct CFS* cfs, struct procParse* pp);
+int RemoveCFS(struct CFS* cfs, struct procParse* pp);
+
+/* Called when pp's number of RUNNABLE lwps becomes or leaves 0 */
+void RequeueCFS(struct CFS* cfs, struct procParse* pp);
+
+/* Process with the lowest vruntime that may run on cpu, 0 if none.
+ * It stays in the tree, with pp->cfsSlice set to its share of the
+ * target latency. */
+struct procParse* SearchCFS(struct CFS* cfs, int cpu);
+
+/* Charge pp one tick, without any lock */
+void ChargeCFS(struct procParse* pp);
+
+#endif // CFS_H
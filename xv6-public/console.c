@@ -16,6 +16,7 @@
 #include "x86.h"
 
 static void consputc(int);
+static void cgaflush(void);
 
 static int panicked = 0;
 
@@ -98,9 +99,10 @@ cprintf(char *fmt, ...)
       break;
     }
   }
-
-  if(locking)
+  if(locking){
+    cgaflush();
     release(&cons.lock);
+  }
 }
 
 void
@@ -128,16 +130,23 @@ panic(char *s)
 #define CRTPORT 0x3d4
 static ushort *crt = (ushort*)P2V(0xb8000);  // CGA memory
 
+// Cursor position: col + 80*row. The hardware cursor is read once
+// and only moved by cgaflush(), not for every character.
+// Protected by cons.lock.
+static int cgapos = -1;
+
 static void
 cgaputc(int c)
 {
   int pos;
 
-  // Cursor position: col + 80*row.
-  outb(CRTPORT, 14);
-  pos = inb(CRTPORT+1) << 8;
-  outb(CRTPORT, 15);
-  pos |= inb(CRTPORT+1);
+  if(cgapos < 0){
+    outb(CRTPORT, 14);
+    cgapos = inb(CRTPORT+1) << 8;
+    outb(CRTPORT, 15);
+    cgapos |= inb(CRTPORT+1);
+  }
+  pos = cgapos;
 
   if(c == '\n')
     pos += 80 - pos%80;
@@ -155,11 +164,20 @@ cgaputc(int c)
     memset(crt+pos, 0, sizeof(crt[0])*(24*80 - pos));
   }
 
+  crt[pos] = ' ' | 0x0700;
+  cgapos = pos;
+}
+
+// Move the hardware cursor to where the output ended.
+static void
+cgaflush(void)
+{
+  if(cgapos < 0)
+    return;
   outb(CRTPORT, 14);
-  outb(CRTPORT+1, pos>>8);
+  outb(CRTPORT+1, cgapos>>8);
   outb(CRTPORT, 15);
-  outb(CRTPORT+1, pos);
-  crt[pos] = ' ' | 0x0700;
+  outb(CRTPORT+1, cgapos);
 }
 
 void
@@ -171,8 +189,19 @@ consputc(int c)
       ;
   }
 
+  // Once panic() stopped locking, nobody will drain the uart.
+  if(!cons.locking){
+    if(c == BACKSPACE){
+      uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    } else
+      uartputc_sync(c);
+    cgaputc(c);
+    cgaflush();
+    return;
+  }
+
   if(c == BACKSPACE){
-    uartputc('\b'); uartputc(' '); uartputc('\b');
+    uartwrite("\b \b", 3);
   } else
     uartputc(c);
   cgaputc(c);
@@ -226,6 +255,7 @@ consoleintr(int (*getc)(void))
       break;
     }
   }
+  cgaflush();
   release(&cons.lock);
   if(doprocdump) {
     procdump();  // now call procdump() wo. cons.lock held
@@ -277,8 +307,17 @@ consolewrite(struct inode *ip, char *buf, int n)
 
   iunlock(ip);
   acquire(&cons.lock);
+  if(panicked){
+    cli();
+    for(;;)
+      ;
+  }
+  // The uart takes the whole buffer, the screen is updated
+  // in memory and the cursor moved once.
+  uartwrite(buf, n);
   for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
+    cgaputc(buf[i] & 0xff);
+  cgaflush();
   release(&cons.lock);
   ilock(ip);
 
@@ -13,6 +13,12 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct procParse;
+struct ExecMap;
+struct PStat;
+struct trapframe;
+struct LockStat;
+struct rwlock;
+struct seqlock;
 
 // bio.c
 void            binit(void);
@@ -33,6 +39,7 @@ int             exec(char*, char**);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+struct file*    filepin(struct file**);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
@@ -72,6 +79,9 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kdup(char*);
+int             krefs(char*);
+int             kfreepages(void);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -84,9 +94,15 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// lockstat.c
+struct LockStat* RegisterLock(char*);
+void            DropLock(struct LockStat*);
+void            HoldLock(struct LockStat*, uint64);
+
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
@@ -99,6 +115,11 @@ void			end_write(int);
 extern int      ismp;
 void            mpinit(void);
 
+// pagecache.c
+void            pcacheinit(void);
+char*           pcacheget(struct inode*, uint);
+void            pcacheinval(struct inode*);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -115,6 +136,10 @@ int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             pagefault(uint, int, int);
+struct spinlock* pgdirlock(pde_t*);
+struct inode*   cwddup(void);
+struct inode*   cwdswap(struct inode*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -123,6 +148,7 @@ void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+void            setstate(struct proc*, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
@@ -130,13 +156,23 @@ void            wakeup(void*);
 void            yield(void);
 int				getppid(void);
 int				getlev(void);
+int				getpstat(struct PStat*, int);
+extern struct rwlock threadDirLock;
 int				set_cpu_share(void);
+int				share_group(int);
+int				set_lwp_share(int, int);
+int				set_realtime(int, int, int);
+int				set_nice(int);
+int				set_affinity(int, int);
+int				set_gang(int);
+int				join_share_group(int, int);
 void			addticks(uint);
 int				checkquantum();
 int 			thread_create(void);
 void			thread_exit(void);
 int 			thread_join(void);
 int				gettid(void);
+int				lwprunning(struct proc*, int);
 void			yield2(void);
 void			sched2(void);
 void			swap2main(void);
@@ -149,10 +185,33 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            droplock(struct spinlock*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// profile.c
+void            ProfileInit(void);
+void            ProfileTick(struct trapframe*);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+
+// schedtrace.c
+void            TraceSched(int, int, int, int, uint);
+
+// seqlock.c
+void            initseqlock(struct seqlock*, char*);
+void            acquireseq(struct seqlock*);
+void            releaseseq(struct seqlock*);
+uint            readseqbegin(struct seqlock*);
+int             readseqretry(struct seqlock*, uint);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -171,6 +230,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argout(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -183,12 +243,14 @@ void            timerinit(void);
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
-extern struct spinlock tickslock;
+extern struct seqlock tickslock;
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartputc_sync(int);
+void            uartwrite(char*, int);
 
 // vm.c
 void            seginit(void);
@@ -202,9 +264,14 @@ void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
+void            switchlwp(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
-void            clearpteu(pde_t *pgdir, char *uva);
+int             setguard(pde_t *pgdir, char *uva);
+int             faultin(pde_t*, struct ExecMap*, uint, int, int);
+int             mapscratch(pde_t*, uint);
+void            shootdown(pde_t*);
+void            tlbintr(void);
 
 // prac_syscall.c
 int		printk_str(char*);
@@ -0,0 +1,133 @@
+#include "edf.h"
+#include "defs.h"
+#include "ticketbox.h"
+#include "thread.h"
+#include "stridequeue.h"
+
+extern struct TicketBox ticketbox;// Total global tickets(remained tickets)
+
+/* EDF is initialized in the userinit() */
+void InitEDF(struct EDF* edf){
+	edf->size = 0;
+}
+
+/* A task needs runtime / deadline of the cpu to meet its deadlines.
+ * Admitted tasks hold that share as tickets, rounded up, so that
+ * the ticketbox bounds real-time and stride load together. */
+int InsertEDF(struct EDF* edf, struct procParse* pp,
+			  int runtime, int period, int deadline, uint now){
+	int ticket;
+	int held;
+
+	if (runtime <= 0 || deadline < runtime || period < deadline ||
+		period > RTMAXPERIOD) {
+		return -1;
+	}
+	ticket = (runtime * 100 + deadline - 1) / deadline;
+	if (ticket <= 0 || ticket > 100) {
+		return -1;
+	}
+
+	/* A task changing its parameters counts its own tickets,
+	 * and so does a stride process which is not in a group */
+	held = 0;
+	if (pp->level == LEVEL_EDF ||
+		(pp->level == -1 && pp->shareGroup == 0)) {
+		held = pp->ticket;
+	}
+
+	acquire(&ticketbox.lock);
+	if (ticket - held > ticketbox.ticket) {
+		release(&ticketbox.lock);
+		return -1;
+	}
+	release(&ticketbox.lock);
+
+	/* Admitted. A stride process gives its tickets back first */
+	if (pp->level == -1) {
+		LeaveStride(pp);
+		held = 0;
+	}
+	acquire(&ticketbox.lock);
+	ticketbox.ticket -= ticket - held;
+	release(&ticketbox.lock);
+
+	if (pp->level != LEVEL_EDF) {
+		edf->tasks[edf->size++] = pp;
+	}
+
+	pp->ticket = ticket;
+	pp->pass = 0;
+	pp->stride = 0;
+	pp->level = LEVEL_EDF;
+	pp->usedTick = 0;
+	pp->usedQuantumTick = 0;
+
+	/* The first period starts now */
+	pp->rtRuntime = runtime;
+	pp->rtPeriod = period;
+	pp->rtDeadline = deadline;
+	pp->rtRelease = now;
+	pp->rtUsed = 0;
+
+	return 0;
+}
+
+/* Take pp out of the class and give its tickets back.
+ * Nothing to do if it is not in. */
+void RemoveEDF(struct EDF* edf, struct procParse* pp){
+	int i;
+
+	for (i = 0; i < edf->size; i++) {
+		if (edf->tasks[i] == pp) {
+			break;
+		}
+	}
+	if (i == edf->size) {
+		return;
+	}
+	edf->tasks[i] = edf->tasks[--edf->size];
+
+	acquire(&ticketbox.lock);
+	ticketbox.ticket += pp->ticket;
+	release(&ticketbox.lock);
+
+	pp->ticket = 0;
+	pp->rtRuntime = 0;
+	pp->rtUsed = 0;
+	// Don't touch MLFQ's information.
+}
+
+/* Move pp's period up to now, refilling its runtime if a new one
+ * started. Periods stay on the grid of the first one, so a task
+ * that slept keeps its phase. */
+static void ReleaseEDF(struct procParse* pp, uint now){
+	uint n = (now - pp->rtRelease) / pp->rtPeriod;
+
+	if (n != 0) {
+		pp->rtRelease += n * pp->rtPeriod;
+		pp->rtUsed = 0;
+	}
+}
+
+/* It takes O(n) in the number of real-time tasks, which are few.
+ * A task runs one lwp at a time, so running ones are skipped. */
+struct procParse* SearchEDF(struct EDF* edf, uint now, int cpu){
+	struct procParse* ret = 0;
+	struct procParse* pp;
+
+	for (int i = 0; i < edf->size; i++) {
+		pp = edf->tasks[i];
+		ReleaseEDF(pp, now);
+
+		if (pp->nrunning != 0 || pp->rtUsed >= pp->rtRuntime ||
+			!RunnableOn(pp, cpu)) {
+			continue;
+		}
+		if (ret == 0 || TICKBEFORE(RTDEADLINE(pp), RTDEADLINE(ret))) {
+			ret = pp;
+		}
+	}
+
+	return ret;
+}
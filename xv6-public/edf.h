@@ -0,0 +1,45 @@
+#ifndef EDF_H
+#define EDF_H
+
+#include "procparse.h"
+#include "param.h"
+
+/* Level of a process in the real-time class.
+ * MLFQ levels are 0 to 2, the stride scheduler's is -1. */
+#define LEVEL_EDF (-2)
+
+/* Whether tick a is before tick b. Ticks may wrap around. */
+#define TICKBEFORE(a, b) ((int)((a) - (b)) < 0)
+
+/* Longest period, so that runtime * 100 fits in an int */
+#define RTMAXPERIOD (1 << 24)
+
+/* Deadline of task pp's current period, in ticks */
+#define RTDEADLINE(pp) ((pp)->rtRelease + (pp)->rtDeadline)
+
+/* Earliest-deadline-first real-time class.
+ * A task may run rtRuntime ticks in every period of rtPeriod ticks,
+ * and should have done so rtDeadline ticks into the period.
+ * Tasks with runtime left are dispatched before stride and MLFQ,
+ * the one with the earliest deadline first. */
+struct EDF {
+	struct procParse* tasks[NPROC];
+	int size;
+};
+
+void InitEDF(struct EDF* edf);
+
+/* Admit pp with the given parameters, against the tickets left
+ * in the ticketbox. A stride process leaves the stride scheduler
+ * once it is admitted, a process on its own counting its tickets
+ * as free. Returns 0, or -1 if they are not free, and pp is left
+ * as it was. */
+int InsertEDF(struct EDF* edf, struct procParse* pp,
+			  int runtime, int period, int deadline, uint now);
+
+void RemoveEDF(struct EDF* edf, struct procParse* pp);
+
+/* Task to run now on cpu, 0 if none. It stays in the class. */
+struct procParse* SearchEDF(struct EDF* edf, uint now, int cpu);
+
+#endif // EDF_H
@@ -8,10 +8,9 @@
 #include "elf.h"
 #include "thread.h"
 #include "spinlock.h"
-#include "ticketbox.h"
 #include "mlfq.h"
-
-extern struct TicketBox ticketbox;
+#include "edf.h"
+#include "stridequeue.h"
 
 extern struct {
   struct spinlock lock;
@@ -21,6 +20,7 @@ extern struct {
 extern struct procParse ppTable[NPROC];
 
 extern struct MLFQ mlfq;
+extern struct EDF edf;
 
 
 
@@ -43,7 +43,7 @@ wakeupthread(struct procParse* pp, void* chan)
 
 			if (t->p != 0 && t->p->state == SLEEPING &&
 					t->p->chan == chan) {
-				t->p->state = RUNNABLE;
+				setstate(t->p, RUNNABLE);
 				t->p->chan = 0;
 			}
 		}
@@ -56,19 +56,25 @@ exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct ExecMap map, oldmap;
   struct proc *curproc = myproc();
-  struct procParse* pp = ppTable + (curproc - ptable.proc);
+  struct procParse* pp = ppTable + (curproc->group - ptable.proc);
 
   // Check exec flag
   // If exec flag is 1, it means that another thread is doing exec
   // Then, go to sleep
   acquire(&ptable.lock);
   while (pp->execFlag) {
+      // The other exec is waiting for this lwp to exit
+      if (curproc->killed) {
+          release(&ptable.lock);
+          return -1;
+      }
       sleep(&pp->execFlag, &ptable.lock);
   }
   pp->execFlag = 1;
@@ -92,6 +98,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  InitExecMap(&map);
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -102,7 +109,8 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map program segments. Their pages are read from
+  // the file when they are first touched.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -113,24 +121,34 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(AddExecSeg(&map, ph.vaddr, ph.filesz, ph.memsz, ph.off,
+                  ph.flags & ELF_PROG_FLAG_WRITE) < 0)
       goto bad;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // Keep the file referenced for the page fault handler.
+  SetExecFile(&map, ip);
+  iunlock(ip);
   end_op();
   ip = 0;
 
-  // Allocate two pages at the next page boundary.
-  // Make the first inaccessible.  Use the second as the user stack.
+  // Reserve three pages at the next page boundary.
+  // Make the first a guard page.  Use the second as the user stack.
+  // The third is the main thread's TLS page.
+  // The pages are faulted in by copyout below.
   sz = PGROUNDUP(sz);
-  if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
+  if(sz + THREAD_USIZE >= KERNBASE)
+    goto bad;
+  sz += THREAD_USIZE;
+  tls = sz - TLSSIZE;
+  if(setguard(pgdir, (char*)(tls - 2*PGSIZE)) < 0)
     goto bad;
-  clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
-  sp = sz;
+  sp = tls;
 
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
@@ -151,16 +169,37 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
+  // The other lwps go away with the old image. Wait for them
+  // before taking pp->lock, which they may be waiting for.
+  acquire(&ptable.lock);
+  if(StopLWPs(pp) < 0){
+    // The process is exiting
+    release(&ptable.lock);
+    goto bad;
+  }
+  release(&ptable.lock);
+
+  // Main thread's TLS. Nothing below can fail.
+  if(SetTls(pgdir, curproc, tls) < 0)
+    goto bad;
+
+  // Commit to the user image.
+  // + initialize thread info
+  acquiresleep(&pp->lock);
+  acquire(&ptable.lock);
+
+  // This lwp carries on as the first lwp, in the ptable slot
+  if(curproc != curproc->group){
+    MoveLWP(curproc);
+    curproc = curproc->group;
+  }
+
   // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
-  // + initialize thread info
-  acquire(&ptable.lock);
-
   // Pop every Address stack
   int size = pp->trashAddrStack.size;
   for(int i = 0; i < size; i++) {
@@ -170,6 +209,7 @@ exec(char *path, char **argv)
   // Remove thread directory's pages
   struct ThreadPage* pg = 0;
   struct Thread* t = 0;
+  acquirewrite(&threadDirLock);
   for(int pn = 0; pn < NTHREADPAGE; pn++) {
       pg = pp->threadDir[pn];
 
@@ -195,10 +235,13 @@ exec(char *path, char **argv)
 	      pp->threadDir[pn] = 0;
 	  }
   }
+  releasewrite(&threadDirLock);
 
   // Remove old page directory and old process's user memory,
   // Set new process information
   oldpgdir = curproc->pgdir;
+  oldmap = pp->execMap;
+  pp->execMap = map;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
@@ -221,7 +264,12 @@ exec(char *path, char **argv)
   
   // this thread points ptable
   t->p = curproc;
+  curproc->thread = t;
   pp->threadNow = t;
+  pp->lwpShare = 0; // The other lwps and their shares are gone
+  pp->lwpPass = 0;
+  pp->gang = 0; // A slice it is in ends at the next pick
+  pp->stopper = 0;
 
   // change exec flag
   // But there are no waiting thread. So no need to call wakeupthread.
@@ -230,57 +278,32 @@ exec(char *path, char **argv)
   /* Process is changed, Initailize scheduling info */
   // If previous process is scheduled by stride scheduler
   if (pp->level == -1) {
-	  // Give ticket back to the ticketbox
+	  // Give ticket back to the ticketbox, or its share group
 	  // Then insert into mlfq
-      acquire(&ticketbox.lock);
-	  ticketbox.ticket += pp->ticket;
-	  release(&ticketbox.lock);
-
-	  pp->ticket = 0;
+	  LeaveStride(pp);
 
 	  InsertMLFQ(&mlfq, pp);
   }
-  else if (pp->level == 0) {
-  	  // Prevous process must be placed front of levelqueue
-	  if (GetFrontLevelQueue(&mlfq.qLevel0) != pp) {
-	      panic("exec err: why current process is not front of queue?\n");
-	  }
-	  
-	  // Pop previous process from level queue
-	  PopLevelQueue(&mlfq.qLevel0);
-	  mlfq.size--;
-
-	  // Push new process into level queue
-  	  InsertMLFQ(&mlfq, pp);
-  }
-  else if (pp->level == 1) {
-  	  // Prevous process must be placed front of levelqueue
-	  if (GetFrontLevelQueue(&mlfq.qLevel1) != pp) {
-	      panic("exec err: why current process is not front of queue?\n");
-	  }
-
-	  // Pop previous process from level queue
-	  PopLevelQueue(&mlfq.qLevel1);
-	  mlfq.size--;
+  else if (pp->level == LEVEL_EDF) {
+	  // Real-time parameters were the old program's
+	  RemoveEDF(&edf, pp);
 
-	  // Push new process into level queue
-  	  InsertMLFQ(&mlfq, pp);
+	  InsertMLFQ(&mlfq, pp);
   }
   else {
-      // Prevous process must be placed front of levelqueue
-	  if (GetFrontLevelQueue(&mlfq.qLevel2) != pp) {
-	      panic("exec err: why current process is not front of queue?\n");
-	  }
-
-	  // Pop previous process from level queue
-	  PopLevelQueue(&mlfq.qLevel2);
-	  mlfq.size--;
+	  // Pop previous process from its level queue
+	  RemoveMLFQ(&mlfq, pp);
 
 	  // Push new process into level queue
   	  InsertMLFQ(&mlfq, pp);
-  }
-  
+  }  
   release(&ptable.lock);
+  releasesleep(&pp->lock);
+
+  // Release the old program file
+  begin_op();
+  FreeExecMap(&oldmap);
+  end_op();
   
   return 0;
 
@@ -291,10 +314,17 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(map.ip){
+    begin_op();
+    FreeExecMap(&map);
+    end_op();
+  }
 
   // exec failed, wake up another threads who are waiting for exec
   acquire(&ptable.lock);
   pp->execFlag = 0;
+  if (pp->stopper == curproc)
+    pp->stopper = 0;
   wakeupthread(pp, &pp->execFlag);
   release(&ptable.lock);  
 
@@ -0,0 +1,121 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "execmap.h"
+
+void InitExecMap(struct ExecMap* m) {
+	m->ip = 0;
+	m->nseg = 0;
+}
+
+// Record a segment. Returns -1 if there are too many.
+int AddExecSeg(struct ExecMap* m, unsigned int va, unsigned int filesz,
+			   unsigned int memsz, unsigned int off, int writable) {
+	struct ExecSeg* s;
+
+	if (m->nseg == NEXECSEG) {
+		return -1;
+	}
+
+	s = &(m->seg[m->nseg++]);
+	s->va = va;
+	s->filesz = filesz;
+	s->memsz = memsz;
+	s->off = off;
+	s->writable = writable;
+	return 0;
+}
+
+// Get the page backing va from the program file.
+// Whole pages of the file come from the page cache and are shared
+// by every process running the program: *perm is PTE_COW for a
+// writable segment, and 0 (read-only) otherwise. The last page of
+// a segment's file part is a private copy, zero past the file part.
+// The page is returned in *mem with a reference for the caller.
+// Reading the file may sleep, so the caller must not hold a spinlock.
+// Returns 1 if *mem is set, 0 if va is not file backed (bss or no
+// segment) and -1 if the page can't be read.
+int GetExecPage(struct ExecMap* m, unsigned int va, char** mem, int* perm) {
+	struct ExecSeg* s;
+	unsigned int n;
+	char* pg;
+	int holding;
+
+	for (int i = 0; i < m->nseg; i++) {
+		s = &(m->seg[i]);
+
+		if (va < s->va || va - s->va >= s->memsz) {
+			continue;
+		}
+
+		// bss
+		if (va - s->va >= s->filesz) {
+			return 0;
+		}
+
+		// A fault while holding a spinlock can't sleep on the inode
+		pushcli();
+		holding = mycpu()->ncli > 1;
+		popcli();
+		if (holding) {
+			return -1;
+		}
+
+		if ((pg = pcacheget(m->ip, s->off + (va - s->va))) == 0) {
+			return -1;
+		}
+
+		n = s->filesz - (va - s->va);
+		if (n >= PGSIZE) {
+			*mem = pg;
+			*perm = s->writable ? PTE_COW : 0;
+			return 1;
+		}
+
+		// Bytes of the file past the segment must read as zero
+		if ((*mem = kalloc()) == 0) {
+			kfree(pg);
+			return -1;
+		}
+		memmove(*mem, pg, n);
+		memset(*mem + n, 0, PGSIZE - n);
+		kfree(pg);
+		*perm = s->writable ? PTE_W : 0;
+		return 1;
+	}
+	return 0;
+}
+
+// Make ip the program file, taking over the caller's reference.
+// Its pages are read while the program runs, so writing it fails
+// from now on, as a mix of old and new pages would not run.
+// Caller holds ip->lock, which writei() holds to check.
+void SetExecFile(struct ExecMap* m, struct inode* ip) {
+	__sync_fetch_and_add(&ip->nexec, 1);
+	m->ip = ip;
+}
+
+// Share src's program file with a forked child.
+void DupExecMap(struct ExecMap* dst, struct ExecMap* src) {
+	*dst = *src;
+	if (dst->ip != 0) {
+		idup(dst->ip);
+		__sync_fetch_and_add(&dst->ip->nexec, 1);
+	}
+}
+
+// Drop the reference to the program file.
+// Caller must be inside a transaction, iput may free the inode.
+void FreeExecMap(struct ExecMap* m) {
+	if (m->ip != 0) {
+		__sync_fetch_and_sub(&m->ip->nexec, 1);
+		iput(m->ip);
+	}
+	InitExecMap(m);
+}
@@ -0,0 +1,31 @@
+#ifndef EXECMAP_H
+#define EXECMAP_H
+
+#define NEXECSEG (4) // ELF load segments a program may have
+
+// ELF load segment of a program.
+struct ExecSeg {
+	unsigned int va; // first user address, page aligned
+	unsigned int filesz; // bytes backed by the program file
+	unsigned int memsz; // bytes in memory, the rest is zero
+	unsigned int off; // file offset of va
+	int writable; // pages are private copies once written
+};
+
+// Program file of a process. Pages of its segments are read
+// from the file when they are first touched, not by exec.
+struct ExecMap {
+	struct inode* ip; // referenced, but not locked
+	int nseg;
+	struct ExecSeg seg[NEXECSEG];
+};
+
+void InitExecMap(struct ExecMap* m);
+int AddExecSeg(struct ExecMap* m, unsigned int va, unsigned int filesz,
+			   unsigned int memsz, unsigned int off, int writable);
+int GetExecPage(struct ExecMap* m, unsigned int va, char** mem, int* perm);
+void SetExecFile(struct ExecMap* m, struct inode* ip);
+void DupExecMap(struct ExecMap* dst, struct ExecMap* src);
+void FreeExecMap(struct ExecMap* m);
+
+#endif // EXECMAP_H
@@ -52,6 +52,21 @@ filedup(struct file *f)
   return f;
 }
 
+// Get the file in descriptor slot *fp, with a reference for the
+// caller, or 0 if the slot is empty. *fp is read under ftable.lock,
+// so an lwp closing the descriptor meanwhile can't free the file.
+struct file*
+filepin(struct file **fp)
+{
+  struct file *f;
+
+  acquire(&ftable.lock);
+  if((f = *fp) != 0)
+    f->ref++;
+  release(&ftable.lock);
+  return f;
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void
 fileclose(struct file *f)
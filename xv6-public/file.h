@@ -14,8 +14,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // Running programs reading it, writes fail meanwhile
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  int pcached;        // may the page cache hold pages of it?
 
   short type;         // copy of disk inode
   short major;
@@ -266,6 +266,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->pcached = 1;    // pages may outlive an earlier entry of it
   release(&icache.lock);
 
   return ip;
@@ -561,6 +562,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcacheinval(ip);
 }
 
 // Copy stat information from inode.
@@ -623,6 +625,9 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  // A running program reads its pages from the file (ETXTBSY)
+  if(ip->nexec > 0)
+    return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -631,6 +636,8 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  if(n > 0)
+    pcacheinval(ip);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -758,7 +765,7 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwddup();
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
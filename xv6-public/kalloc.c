@@ -21,6 +21,8 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;            // number of pages on freelist
+  ushort ref[PHYSTOP/PGSIZE]; // references to each allocated page
 } kmem;
 
 // Initialization happens in two phases.
@@ -52,18 +54,33 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
+// Drop a reference to the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when the last reference is dropped.
 void
 kfree(char *v)
 {
   struct run *r;
+  ushort *ref;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  ref = &kmem.ref[V2P(v) / PGSIZE];
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(*ref > 1){
+    (*ref)--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  *ref = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -72,6 +89,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -87,10 +105,43 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+    kmem.ref[V2P(r) / PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to an allocated page, so that it can be
+// shared. Each reference is dropped with kfree().
+void
+kdup(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kdup");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) / PGSIZE] == 0)
+    panic("kdup: free page");
+  kmem.ref[V2P(v) / PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Number of references to an allocated page.
+int
+krefs(char *v)
+{
+  return kmem.ref[V2P(v) / PGSIZE];
+}
+
+// Number of free physical pages. Only a hint,
+// it may be stale as soon as it is returned.
+int
+kfreepages(void)
+{
+  return kmem.nfree;
+}
+
@@ -0,0 +1,203 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "memlayout.h"
+#include "profile.h"
+
+// Kernel profiler front end.
+//
+// usage: kprof start          start sampling, with empty buffers
+//        kprof stop           stop sampling
+//        kprof report         show where the samples fell
+//        kprof run cmd [arg...]
+//                             sample while cmd runs, then report
+//
+// Samples are named after the kernel functions in /kernel.sym.
+// SELF counts samples taken inside a function, TOTAL counts
+// samples with the function anywhere on the sampled stack.
+
+#define NSYM    1024
+#define NPOOL   (16*1024)
+#define NTOP    20
+
+struct sym {
+  uint addr;
+  char *name;
+};
+
+struct sym syms[NSYM];
+int nsym;
+char pool[NPOOL];
+
+struct ProfSample samples[NCPU * NPROFSAMPLE];
+int nsample;
+
+int self[NSYM], total[NSYM];
+
+// Read "addr name" lines of kernel.sym, keeping kernel text and
+// data symbols, sorted by address.
+static int
+loadsyms(char *path)
+{
+  FILE *f;
+  struct sym t;
+  char name[64];
+  uint addr;
+  int c, n, np, i, j, gap;
+
+  if((f = fopen(path, "r")) == 0)
+    return -1;
+
+  np = 0;
+  for(;;){
+    addr = 0;
+    while((c = fgetc(f)) != EOF && c != ' '){
+      if(c >= '0' && c <= '9')
+        addr = addr * 16 + c - '0';
+      else if(c >= 'a' && c <= 'f')
+        addr = addr * 16 + c - 'a' + 10;
+    }
+    n = 0;
+    while(c != EOF && (c = fgetc(f)) != EOF && c != '\n')
+      if(n < sizeof(name) - 1)
+        name[n++] = c;
+    if(c == EOF)
+      break;
+    name[n++] = 0;
+
+    // File names and absolute symbols sit at address 0
+    if(addr < KERNLINK)
+      continue;
+    if(nsym == NSYM || np + n > NPOOL)
+      break;
+    syms[nsym].addr = addr;
+    syms[nsym].name = pool + np;
+    memmove(pool + np, name, n);
+    np += n;
+    nsym++;
+  }
+  fclose(f);
+
+  // Shell sort by address
+  for(gap = nsym / 2; gap > 0; gap /= 2)
+    for(i = gap; i < nsym; i++)
+      for(j = i - gap; j >= 0 && syms[j].addr > syms[j+gap].addr; j -= gap){
+        t = syms[j];
+        syms[j] = syms[j+gap];
+        syms[j+gap] = t;
+      }
+  return 0;
+}
+
+// Index of the symbol containing pc, or -1.
+static int
+lookup(uint pc)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = nsym - 1;
+  if(nsym == 0 || pc < syms[0].addr)
+    return -1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+static void
+report(void)
+{
+  struct ProfSample *s;
+  int cpu, n, i, d, k, seen[NPROFDEPTH], nseen, nuser, best, top;
+
+  nsample = 0;
+  for(cpu = 0; (n = profread(cpu, samples + nsample, NPROFSAMPLE)) >= 0; cpu++)
+    nsample += n;
+  if(nsample == 0){
+    printf(1, "no samples\n");
+    return;
+  }
+
+  if(loadsyms("/kernel.sym") < 0)
+    printf(2, "kprof: cannot read /kernel.sym, showing addresses\n");
+
+  nuser = 0;
+  for(i = 0; i < nsample; i++){
+    s = &samples[i];
+    if(s->pc[0] < KERNBASE){
+      nuser++;
+      continue;
+    }
+    nseen = 0;
+    for(d = 0; d < NPROFDEPTH && s->pc[d] != 0; d++){
+      if((k = lookup(s->pc[d])) < 0)
+        continue;
+      if(d == 0)
+        self[k]++;
+      // Recursion must not count a function twice
+      for(n = 0; n < nseen && seen[n] != k; n++)
+        ;
+      if(n == nseen){
+        seen[nseen++] = k;
+        total[k]++;
+      }
+    }
+  }
+
+  printf(1, "%d samples, %d in user space, %d in the kernel\n",
+         nsample, nuser, nsample - nuser);
+  printf(1, "SELF %%SELF TOTAL FUNCTION\n");
+  for(top = 0; top < NTOP; top++){
+    best = -1;
+    for(k = 0; k < nsym; k++)
+      if(self[k] + total[k] > 0 &&
+         (best < 0 || self[k] > self[best] ||
+          (self[k] == self[best] && total[k] > total[best])))
+        best = k;
+    if(best < 0)
+      break;
+    printf(1, "%d %d%% %d %s\n", self[best], self[best] * 100 / nsample,
+           total[best], syms[best].name);
+    self[best] = total[best] = 0;
+  }
+  if(nsym == 0)
+    for(i = 0; i < nsample && i < NTOP; i++)
+      printf(1, "%x\n", samples[i].pc[0]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc >= 2 && strcmp(argv[1], "start") == 0)
+    profctl(1);
+  else if(argc >= 2 && strcmp(argv[1], "stop") == 0)
+    profctl(0);
+  else if(argc >= 2 && strcmp(argv[1], "report") == 0)
+    report();
+  else if(argc >= 3 && strcmp(argv[1], "run") == 0){
+    profctl(1);
+    if((pid = fork()) < 0){
+      profctl(0);
+      printf(2, "kprof: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[2], argv + 2);
+      printf(2, "kprof: exec %s failed\n", argv[2]);
+      exit();
+    }
+    wait();
+    profctl(0);
+    report();
+  } else
+    printf(2, "usage: kprof start | stop | report | run cmd [arg...]\n");
+  exit();
+}
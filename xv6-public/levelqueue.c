@@ -6,55 +6,96 @@ void InitLevelQueue(struct LevelQueue* levelQ,
 					int level,
 					int timeQuantum,
 					int timeAllotment){
-	levelQ->size = 0;
-	levelQ->front = 0;
-	levelQ->back = -1;
+	levelQ->ready.head = levelQ->ready.tail = 0;
+	levelQ->ready.size = 0;
+	levelQ->blocked.head = levelQ->blocked.tail = 0;
+	levelQ->blocked.size = 0;
 
 	levelQ->timeQuantum = timeQuantum;
 	levelQ->timeAllotment = timeAllotment;
 	levelQ->level = level;
 }
 
-/* Push procParse's address into LevelQueue */
+/* Push procParse's address at the back of the ready list
+ * If it has a RUNNABLE lwp, else into the blocked list.
+ * pp must not be in any list. */
 void PushLevelQueue(struct LevelQueue* levelQ, struct procParse* pp) {
-	if (levelQ->size == NPROC){
-		return;
+	struct LevelList* list;
+
+	if (pp->list != 0) {
+		panic("PushLevelQueue: already queued");
 	}
 
-	if (levelQ->back + 1 == NPROC){
-		levelQ->back = 0;
+	list = pp->nrunnable > 0 ? &levelQ->ready : &levelQ->blocked;
+
+	pp->next = 0;
+	pp->prev = list->tail;
+	if (list->tail != 0) {
+		list->tail->next = pp;
 	}
 	else {
-		levelQ->back++;
+		list->head = pp;
 	}
-
-	levelQ->queue[levelQ->back] = pp;
-	levelQ->size++;
+	list->tail = pp;
+	list->size++;
+	pp->list = list;
 }
 
-/* Pop front of LevelQueue */
-void PopLevelQueue(struct LevelQueue* levelQ) {	
-	if (levelQ->size == 0){
+/* Remove pp from the list it is in, if any */
+void RemoveLevelQueue(struct procParse* pp) {	
+	struct LevelList* list = pp->list;
+
+	if (list == 0){
 		return;
 	}
 
-	if (levelQ->front + 1 == NPROC) {
-		levelQ->front = 0;
+	if (pp->prev != 0) {
+		pp->prev->next = pp->next;
+	}
+	else {
+		list->head = pp->next;
+	}
+	if (pp->next != 0) {
+		pp->next->prev = pp->prev;
 	}
 	else {
-		levelQ->front++;
+		list->tail = pp->prev;
 	}
 
-	levelQ->size--;
+	pp->next = pp->prev = 0;
+	pp->list = 0;
+	list->size--;
 }
 
-/* Get the front of LevelQueue */
+/* Get the front of LevelQueue's ready list */
 struct procParse* GetFrontLevelQueue(struct LevelQueue* levelQ) {
-	struct procParse* ret = 0;
+	return levelQ->ready.head;
+}
+
+/* Move from's list at the back of to's list */
+static void AppendLevelList(struct LevelList* to, struct LevelList* from) {
+	if (from->head == 0) {
+		return;
+	}
 
-	if (levelQ->size != 0) {
-		ret = levelQ->queue[levelQ->front];
+	if (to->tail != 0) {
+		to->tail->next = from->head;
+		from->head->prev = to->tail;
 	}
+	else {
+		to->head = from->head;
+	}
+	to->tail = from->tail;
+	to->size += from->size;
+
+	from->head = from->tail = 0;
+	from->size = 0;
+}
 
-	return ret;
+/* Move all processes of from to the back of to, in O(1).
+ * Their pp->list still points into from.
+ * The caller must fix it before they are moved again. */
+void AppendLevelQueue(struct LevelQueue* to, struct LevelQueue* from) {
+	AppendLevelList(&to->ready, &from->ready);
+	AppendLevelList(&to->blocked, &from->blocked);
 }
@@ -3,16 +3,25 @@
 
 #include "procparse.h"
 
-/* MLFQ Scheduler need level queue */
+/* Doubly linked list of procParse,
+ * Linked through pp->next and pp->prev */
+struct LevelList {
+	struct procParse* head;
+	struct procParse* tail;
+	int size;
+};
+
+/* MLFQ Scheduler need level queue.
+ * Processes with a RUNNABLE lwp wait in the ready list, in FIFO order.
+ * The others are kept in the blocked list until one of their lwps
+ * becomes RUNNABLE, so picking never has to skip over them. */
 struct LevelQueue{
 	int level;
 	int timeAllotment; // Time for changing level
 	int timeQuantum; // Time for Round Robin Scheduling
 
-	struct procParse* queue[NPROC];
-	int size;
-	int front; // Front index of queue array
-	int back; // Back index of queue array
+	struct LevelList ready;
+	struct LevelList blocked;
 };
 
 void InitLevelQueue(struct LevelQueue* levelQ, 
@@ -20,7 +29,8 @@ void InitLevelQueue(struct LevelQueue* levelQ,
 					int timeQuantum,
 					int timeAllotment);
 void PushLevelQueue(struct LevelQueue* levelQ, struct procParse* pp);
-void PopLevelQueue(struct LevelQueue* levelQ);
+void RemoveLevelQueue(struct procParse* pp);
 struct procParse* GetFrontLevelQueue(struct LevelQueue* levelQ);
+void AppendLevelQueue(struct LevelQueue* to, struct LevelQueue* from);
 
 #endif // LEVELQUEUE_H
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+// Show spinlock contention, most spun-on locks first.
+//
+// usage: locks [-r] [-h]
+//   -r  clear the counters after reading them
+//   -h  also print each lock's hold time histogram
+// Cycle counts are in units of 1024 cycles (k).
+
+struct LockStat st[NLOCKSTAT];
+
+#define KCYCLE(c) ((uint)((c) >> 10))
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, j, best, reset, hist;
+  struct LockStat *s;
+  char done[NLOCKSTAT];
+
+  reset = hist = 0;
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-r") == 0)
+      reset = 1;
+    else if(strcmp(argv[i], "-h") == 0)
+      hist = 1;
+    else {
+      printf(2, "usage: locks [-r] [-h]\n");
+      exit();
+    }
+  }
+
+  if((n = lockstat(st, NLOCKSTAT, reset)) < 0){
+    printf(2, "locks: lockstat failed\n");
+    exit();
+  }
+
+  if(n == 0){
+    printf(1, "no lock statistics, the kernel is built without LOCKSTAT=on\n");
+    exit();
+  }
+
+  printf(1, "NAME LOCKS ACQUIRE CONTEND SPINK HOLDK AVGHOLD MAXHOLD\n");
+  memset(done, 0, sizeof(done));
+  for(i = 0; i < n; i++){
+    best = -1;
+    for(j = 0; j < n; j++)
+      if(!done[j] && (best < 0 || st[j].spintsc > st[best].spintsc ||
+         (st[j].spintsc == st[best].spintsc && st[j].nacquire > st[best].nacquire)))
+        best = j;
+    done[best] = 1;
+    s = &st[best];
+
+    printf(1, "%s %d %d %d %d %d %d %d\n", s->name, s->nlock, s->nacquire,
+           s->ncontend, KCYCLE(s->spintsc), KCYCLE(s->holdtsc),
+           s->nacquire ? KCYCLE(s->holdtsc) / s->nacquire : 0,
+           KCYCLE(s->maxhold));
+    if(hist){
+      printf(1, "  hold <2^8:%d", s->hold[0]);
+      for(j = 1; j < NHOLDHIST - 1; j++)
+        printf(1, " <2^%d:%d", 8 + 2*j, s->hold[j]);
+      printf(1, " more:%d\n", s->hold[NHOLDHIST - 1]);
+    }
+  }
+  exit();
+}
@@ -0,0 +1,112 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "mmu.h"
+#include "lockstat.h"
+
+// Spinlock statistics, one entry per lock name.
+//
+// Only kept in kernels built with make LOCKSTAT=on.
+// initlock() looks up the entry of its name once, and
+// acquire() and release() update it through lk->stat.
+// The table is only ever appended to, so entries stay put.
+
+static struct {
+	volatile uint locked; // Guards appending. Not a spinlock,
+						  // which would need an entry itself.
+	int n;
+	struct LockStat stat[NLOCKSTAT];
+} lockTable;
+
+// Entry of name, added if it is new. 0 if the table is full.
+// The first locks are made before mpinit(), when mycpu() cannot work
+// yet, so interrupts are turned off here without pushcli().
+struct LockStat* RegisterLock(char* name) {
+	struct LockStat* s;
+	uint eflags;
+	int i;
+
+	eflags = readeflags();
+	cli();
+	while (xchg(&lockTable.locked, 1) != 0)
+		;
+
+	s = 0;
+	for (i = 0; i < lockTable.n; i++) {
+		if (strncmp(lockTable.stat[i].name, name, sizeof(s->name) - 1) == 0) {
+			s = &(lockTable.stat[i]);
+			break;
+		}
+	}
+	if (s == 0 && lockTable.n < NLOCKSTAT) {
+		s = &(lockTable.stat[lockTable.n++]);
+		safestrcpy(s->name, name, sizeof(s->name));
+	}
+	if (s != 0) {
+		__sync_fetch_and_add(&s->nlock, 1); // DropLock() takes no lock
+	}
+
+	xchg(&lockTable.locked, 0);
+	if (eflags & FL_IF) {
+		sti();
+	}
+	return s;
+}
+
+// A lock of s's name is gone.
+void DropLock(struct LockStat* s) {
+	__sync_fetch_and_sub(&s->nlock, 1);
+}
+
+// Account a hold of cycles, called by release() under the lock.
+void HoldLock(struct LockStat* s, uint64 cycles) {
+	int i;
+	uint64 limit;
+
+	s->holdtsc += cycles;
+	if (cycles > s->maxhold) {
+		s->maxhold = cycles;
+	}
+	limit = 1 << 8;
+	for (i = 0; i < NHOLDHIST - 1 && cycles >= limit; i++) {
+		limit <<= 2;
+	}
+	s->hold[i]++;
+}
+
+// int lockstat(struct LockStat* buf, int n, int reset)
+// Copy up to n entries into buf, then clear the counters if reset.
+// Returns the number of entries copied.
+int
+sys_lockstat(void)
+{
+	struct LockStat* buf;
+	struct LockStat* s;
+	int n, reset, i;
+
+	if (argint(1, &n) < 0 || argint(2, &reset) < 0) {
+		return -1;
+	}
+	if (n < 0 || n > NLOCKSTAT) {
+		return -1;
+	}
+	if (argptr(0, (char**)&buf, n * sizeof(struct LockStat)) < 0) {
+		return -1;
+	}
+
+	if (n > lockTable.n) {
+		n = lockTable.n;
+	}
+	memmove(buf, lockTable.stat, n * sizeof(struct LockStat));
+
+	if (reset) {
+		for (i = 0; i < lockTable.n; i++) {
+			s = &(lockTable.stat[i]);
+			s->nacquire = s->ncontend = 0;
+			s->spintsc = s->holdtsc = s->maxhold = 0;
+			memset(s->hold, 0, sizeof(s->hold));
+		}
+	}
+	return n;
+}
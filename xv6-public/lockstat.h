@@ -0,0 +1,24 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#define NLOCKSTAT (64) // Lock names tracked
+#define NHOLDHIST (8)  // Hold time histogram buckets
+
+// Statistics of all spinlocks initialized with one name.
+// Locks that share a name (pipes, sleep locks) update the entry
+// without synchronization, so their counts are approximate.
+// Times are in rdtsc() cycles.
+struct LockStat {
+	char name[16];
+	uint nlock; // Locks with this name, freed ones call droplock()
+	uint nacquire; // Acquisitions
+	uint ncontend; // Acquisitions that found the lock held
+	uint64 spintsc; // Cycles spent spinning
+	uint64 holdtsc; // Cycles the lock was held
+	uint64 maxhold; // Longest hold
+	// hold[i] counts holds shorter than 2^(8+2i) cycles,
+	// the last bucket also counts the longer ones
+	uint hold[NHOLDHIST];
+};
+
+#endif // LOCKSTAT_H
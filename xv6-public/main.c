@@ -29,7 +29,9 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcacheinit();    // program page cache
   fileinit();      // file table
+  ProfileInit();   // kernel profiler
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
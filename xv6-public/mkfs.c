@@ -260,7 +260,7 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, y, dbn;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,7 +273,7 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
@@ -283,6 +283,25 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      // Double indirect block, laid out like bmap() in fs.c
+      dbn = fbn - NDIRECT - NINDIRECT;
+      assert(dbn < NDINDIRECT);
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      if(indirect[dbn / NINDIRECT] == 0){
+        indirect[dbn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      y = xint(indirect[dbn / NINDIRECT]);
+      rsect(y, (char*)indirect);
+      if(indirect[dbn % NINDIRECT] == 0){
+        indirect[dbn % NINDIRECT] = xint(freeblock++);
+        wsect(y, (char*)indirect);
+      }
+      x = xint(indirect[dbn % NINDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
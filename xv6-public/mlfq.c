@@ -1,9 +1,11 @@
 #include "mlfq.h"
 #include "defs.h"
 #include "ticketbox.h"
+#include "stridequeue.h"
+#include "schedtrace.h"
+#include "thread.h"
 
 extern struct TicketBox ticketbox;// Total global tickets(remained tickets)
-extern double CONST_FOR_STRIDE; // Used in making stride
 
 /* MLFQ has time limits for scheduling process.
  * Declare these limits to the constants. */
@@ -20,6 +22,12 @@ const int TIME_ALLOT_LEVEL2 = -1;
 /* MLFQ has boosting period */
 const int BOOSTING_PERIOD = 200;
 
+/* A process that left another cpu up to AFFINITY_HOT ticks ago
+ * still has its cache there. It is left to that cpu if one of the
+ * next AFFINITY_LOOKAHEAD processes of its list can run instead. */
+const int AFFINITY_HOT = 2;
+const int AFFINITY_LOOKAHEAD = 4;
+
 extern struct spinlock ticketLock;
 
 /* MLFQ is initialized in the userinit() */
@@ -29,9 +37,10 @@ void InitMLFQ(struct MLFQ* mlfq, int ticket){
 	release(&ticketbox.lock);
 
 	mlfq->size = 0;
-	mlfq->stride = CONST_FOR_STRIDE / ticket;
+	mlfq->stride = STRIDE1 / ticket;
 	mlfq->pass = 0;
 	mlfq->usedTick = 0;
+	mlfq->epoch = 0;
 
 	InitLevelQueue(&mlfq->qLevel0, 0,
 					TIME_QUANTUM_LEVEL0, TIME_ALLOT_LEVEL0);
@@ -41,172 +50,152 @@ void InitMLFQ(struct MLFQ* mlfq, int ticket){
 	
 	InitLevelQueue(&mlfq->qLevel2, 2,
 					TIME_QUANTUM_LEVEL2, TIME_ALLOT_LEVEL2);
+
+#ifdef SCHED_CFS
+	InitCFS(&mlfq->cfs);
+#endif
 }
 
-struct procParse* SearchMLFQ(struct MLFQ* mlfq){
-	struct procParse* pp = 0;
-	struct procParse* ret = 0;
-	
-	/* If MLFQ used 100 ticks, Boost all processes */
-	if (mlfq->usedTick >= BOOSTING_PERIOD) {
-		BoostMLFQ(mlfq);
-		mlfq->usedTick = 0;
+/* Level queue of level */
+static struct LevelQueue* GetLevelQueue(struct MLFQ* mlfq, int level) {
+	if (level == 0) {
+		return &mlfq->qLevel0;
 	}
+	else if (level == 1) {
+		return &mlfq->qLevel1;
+	}
+	return &mlfq->qLevel2;
+}
 
-	/* If qlevel0 has process, select the runnable process */
-	if (mlfq->qLevel0.size != 0) {
-		pp = GetFrontLevelQueue(&mlfq->qLevel0);
+/* Boosting only counts an epoch and moves the lists.
+ * Point pp at the list it was moved to, if it missed a boost. */
+static void SyncListMLFQ(struct MLFQ* mlfq, struct procParse* pp) {
+	if (pp->list == 0 || pp->epoch == mlfq->epoch) {
+		return;
+	}
 
-		/* If front process already used time quantum,
-		 * Move it to same level's back */
-		if (mlfq->qLevel0.timeQuantum <= pp->usedQuantumTick) {
-			PopLevelQueue(&mlfq->qLevel0);
-			PushLevelQueue(&mlfq->qLevel0, pp);
-		
-			/* Initialize pp's used quanutm tick */
-			pp->usedQuantumTick = 0;
-		}
+	/* Its list was appended to level 0's list of the same kind */
+	if (pp->list == &mlfq->qLevel0.ready ||
+		pp->list == &mlfq->qLevel1.ready ||
+		pp->list == &mlfq->qLevel2.ready) {
+		pp->list = &mlfq->qLevel0.ready;
+	}
+	else {
+		pp->list = &mlfq->qLevel0.blocked;
+	}
+}
 
-		/* Search runnable process.
-		 * In the loop, level queue's size can be changed.
-		 * So, save original size to possible to check all components */
-		int originalSize = mlfq->qLevel0.size;
-		for (int i = 0; i < originalSize; i++) {
-			pp = GetFrontLevelQueue(&mlfq->qLevel0);
-
-			/* If front process is not selectable,
-			 * Pop it. No push again */
-			if (pp->level == -1 || // It is managed by stride scheduler.
-				pp->p->state == UNUSED ||
-				pp->p->state == ZOMBIE) {
-				PopLevelQueue(&mlfq->qLevel0);
-				mlfq->size--;
-			}
-			/* Else if front process already used time allotment,
-			 * Move it to low level */
-			else if (pp->usedTick >= mlfq->qLevel0.timeAllotment) {
-				PopLevelQueue(&mlfq->qLevel0);
-				PushLevelQueue(&mlfq->qLevel1, pp);
+/* Processes catch up with a boost when they are next looked at.
+ * Everything moving a pp inside MLFQ calls this first. */
+static void SyncMLFQ(struct MLFQ* mlfq, struct procParse* pp) {
+	if (pp->list == 0 || pp->epoch == mlfq->epoch) {
+		return;
+	}
+	SyncListMLFQ(mlfq, pp);
+
+	/* Initialize tick information */
+	pp->usedTick = 0;
+	pp->usedQuantumTick = 0;
+	pp->level = 0; // Change level to highest level
+	pp->epoch = mlfq->epoch;
+}
+
+/* Front of levelQ's ready list, after moving processes
+ * which used their time allotment to lower, and rotating
+ * the front once if it used its time quantum.
+ * lower is 0 for the lowest level. */
+static struct procParse* PickLevelQueue(struct MLFQ* mlfq,
+										struct LevelQueue* levelQ,
+										struct LevelQueue* lower) {
+	struct procParse* pp = 0;
+	int rotated = 0;
+
+	while ((pp = GetFrontLevelQueue(levelQ)) != 0) {
+		SyncMLFQ(mlfq, pp);
+
+		/* If front process already used time allotment,
+		 * Move it to low level */
+		if (lower != 0 && pp->usedTick >= levelQ->timeAllotment) {
+			RemoveLevelQueue(pp);
 		
-				/* Initialize process's used tick */
-				pp->usedTick = 0;
-				pp->usedQuantumTick = 0;
-				pp->level = 1; // Change the level
-			}
-			/* Else if process is runnable, select it. */
-			else if (pp->p->state == RUNNABLE) {
-				ret = pp;
-				break;
-			}
-			/* Else this process is not runnable,
-			 * just pop and push again */
-			else {
-				PopLevelQueue(&mlfq->qLevel0);
-				PushLevelQueue(&mlfq->qLevel0, pp);
-			}
+			/* Initialize process's used tick */
+			pp->usedTick = 0;
+			pp->usedQuantumTick = 0;
+			pp->level = lower->level; // Change the level
+			PushLevelQueue(lower, pp);
+			TraceSched(TRACE_DEMOTE, pp->p->pid, 0, lower->level, 0);
 		}
-	}
-	
-	/* Even if qlevel0 has process, 
-	 * It is possible there are no runnable process.
-	 * In this case, check the qlevel1 to select the runnable process.
-	 * So, use "if". Not "else if" */
-	if (ret == 0 && mlfq->qLevel1.size != 0) {
-		pp = GetFrontLevelQueue(&mlfq->qLevel1);
-		/* If process already used time quantum,
+		/* Else if front process already used time quantum,
 		 * Move it to same level's back */
-		if (mlfq->qLevel1.timeQuantum <= pp->usedQuantumTick) {
-			PopLevelQueue(&mlfq->qLevel1);
-			PushLevelQueue(&mlfq->qLevel1, pp);
-		
-			/* Initialize process's used quanutm tick */
+		else if (!rotated && pp->usedQuantumTick >= levelQ->timeQuantum) {
+			RemoveLevelQueue(pp);
+			PushLevelQueue(levelQ, pp);
+			rotated = 1;
+
+			/* Initialize pp's used quanutm tick */
 			pp->usedQuantumTick = 0;
 		}
+		else {
+			break;
+		}
+	}
 
-		/* Search runnable process.
-		 * In the loop, level queue's size can be changed.
-		 * So, save original size to possible to check all components */
-		int originalSize = mlfq->qLevel1.size;
-		for (int i = 0; i < originalSize; i++) {
-			pp = GetFrontLevelQueue(&mlfq->qLevel1);
-
-			/* If front process is not selectable,
-			 * Pop it. No push again */
-			if (pp->level == -1 ||
-				pp->p->state == UNUSED ||
-				pp->p->state == ZOMBIE) {
-				PopLevelQueue(&mlfq->qLevel1);	
-				mlfq->size--;
-			}
-			/* Else if front process already used time allotment,
-			 * Move it to low level */
-			else if (pp->usedTick >= mlfq->qLevel1.timeAllotment) {
-				PopLevelQueue(&mlfq->qLevel1);
-				PushLevelQueue(&mlfq->qLevel2, pp);
-		
-				/* Initialize process's used tick */
-				pp->usedTick = 0;
-				pp->usedQuantumTick = 0;
-				pp->level = 2; // Change the level
-			}
-			/* Else if process is runnable, select it. */
-			else if (pp->p->state == RUNNABLE) {
-				ret = pp;
-				break;
-			}
-			/* Else this process is not runnable,
-			 * just pop and push again */
-			else {
-				PopLevelQueue(&mlfq->qLevel1);
-				PushLevelQueue(&mlfq->qLevel1, pp);
-			}
+	return pp;
+}
+
+/* Process of the ready list from pp on to run on cpu, 0 if none may.
+ * The first that may, unless it is warm on another cpu.
+ * Processes pinned to other cpus are passed over without counting. */
+static struct procParse* PlaceLevelQueue(struct procParse* pp, int cpu) {
+	struct procParse* first = 0;
+	int n = 0;
+
+	for (; pp != 0 && n < AFFINITY_LOOKAHEAD; pp = pp->next) {
+		if (!RunnableOn(pp, cpu)) {
+			continue;
 		}
+		if (pp->lastCpu < 0 || pp->lastCpu == cpu ||
+			ticks - pp->lastTick > AFFINITY_HOT) {
+			return pp;
+		}
+		if (first == 0) {
+			first = pp;
+		}
+		n++;
+	}
+	return first;
+}
+
+struct procParse* SearchMLFQ(struct MLFQ* mlfq, int cpu){
+	struct procParse* ret = 0;
 
+#ifdef SCHED_CFS
+	/* No levels to boost, a sleeper's vruntime catches up instead */
+	return SearchCFS(&mlfq->cfs, cpu);
+#endif
+	
+	/* If MLFQ used 100 ticks, Boost all processes */
+	if (mlfq->usedTick >= BOOSTING_PERIOD) {
+		BoostMLFQ(mlfq);
+		mlfq->usedTick = 0;
+		TraceSched(TRACE_BOOST, 0, 0, 0, 0);
 	}
 
-	/* With the same reason, use "if". Not "else if" */
-	if (ret == 0 && mlfq->qLevel2.size != 0) {
-		pp = GetFrontLevelQueue(&mlfq->qLevel2);
-		/* If process already used time quantum,
-		 * Move it to same level's back */
-		if (mlfq->qLevel2.timeQuantum <= pp->usedQuantumTick) {
-			PopLevelQueue(&mlfq->qLevel2);
-			PushLevelQueue(&mlfq->qLevel2, pp);
-		
-			/* Initialize process's used quanutm tick */
-			pp->usedQuantumTick = 0;
-		}
+	/* Only processes with a RUNNABLE lwp are in the ready lists.
+	 * So the first ready process of the highest level is selected,
+	 * Without looking at the sleeping ones. */
+	ret = PlaceLevelQueue(
+			PickLevelQueue(mlfq, &mlfq->qLevel0, &mlfq->qLevel1), cpu);
+	
+	if (ret == 0) {
+		ret = PlaceLevelQueue(
+				PickLevelQueue(mlfq, &mlfq->qLevel1, &mlfq->qLevel2), cpu);
+	}
 
-		/* Level2 is lowest level. So it has no limited time allotment.
-		 * So, just check time quantum only. */
-
-		/* Search runnable process. 
-		 * In the loop, level queue's size can be changed.
-		 * So, save original size to possible to check all components */
-		int originalSize = mlfq->qLevel2.size;
-		for (int i = 0; i < originalSize; i++) {
-			pp = GetFrontLevelQueue(&mlfq->qLevel2);
-
-			/* If front process is not selectable,
-			 * Pop it. No push again */
-			if (pp->level ==  -1 ||
-				pp->p->state == UNUSED ||
-				pp->p->state == ZOMBIE) {
-				PopLevelQueue(&mlfq->qLevel2);
-				mlfq->size--;
-			}
-			/* Else if process is runnable, select it. */
-			else if (pp->p->state == RUNNABLE) {
-				ret = pp;
-				break;
-			}
-			/* Else this process is not runnable,
-			 * just pop and push again */
-			else {
-				PopLevelQueue(&mlfq->qLevel2);
-				PushLevelQueue(&mlfq->qLevel2, pp);
-			}
-		}	
+	/* Level2 is lowest level. So it has no limited time allotment.
+	 * So, just check time quantum only. */
+	if (ret == 0) {
+		ret = PlaceLevelQueue(PickLevelQueue(mlfq, &mlfq->qLevel2, 0), cpu);
 	}
 
 	return ret;
@@ -214,61 +203,26 @@ struct procParse* SearchMLFQ(struct MLFQ* mlfq){
 
 /* Boost all process's level to highest level.
  * Lowest level queue's processes may be more starved.
- * So, the lower level, make it the higher priroriry. */
+ * So, the lower level, make it the higher priroriry.
+ * Processes get their new level and ticks in SyncMLFQ(),
+ * so this takes the same time however many there are. */
 void BoostMLFQ(struct MLFQ* mlfq){
-	struct LevelQueue tmpQ; // qLevel0 will be saved at this queue.
-	tmpQ.size = 0;
-	tmpQ.front = 0;
-	tmpQ.back = -1;
-
-	/* Save highest queue */
-	int originalSize = mlfq->qLevel0.size;
-	struct procParse* target;
-	for (int i = 0; i < originalSize; i++) {
-		target = GetFrontLevelQueue(&mlfq->qLevel0);
-		PopLevelQueue(&mlfq->qLevel0);
-		PushLevelQueue(&tmpQ, target); // Push to the tmpQ
-	}
+	/* Gather everything in the lowest level queue,
+	 * Middle and highest level behind the lowest. */
+	AppendLevelQueue(&mlfq->qLevel2, &mlfq->qLevel1);
+	AppendLevelQueue(&mlfq->qLevel2, &mlfq->qLevel0);
 
-	/* Move low level queue to highest level queue */
-	originalSize = mlfq->qLevel2.size; // lowest level queue
-	for (int i = 0; i < originalSize; i++) {
-		target = GetFrontLevelQueue(&mlfq->qLevel2);
+	/* Then move it to the highest level queue, in that order */
+	AppendLevelQueue(&mlfq->qLevel0, &mlfq->qLevel2);
 
-		/* Initialize tick information */
-		target->usedTick = 0;
-		target->usedQuantumTick = 0;
-		target->level = 0; // Change level to highest level
-
-		PopLevelQueue(&mlfq->qLevel2);
-		PushLevelQueue(&mlfq->qLevel0, target); // Push to the level0
-	}
+	mlfq->epoch++;
+}
 
-	originalSize = mlfq->qLevel1.size; // Middle level queue
-	for (int i = 0; i <originalSize; i++) {
-		target = GetFrontLevelQueue(&mlfq->qLevel1);
-		
-		/* Initialize tick information */
-		target->usedTick = 0;
-		target->usedQuantumTick = 0;
-		target->level = 0; // Change level to highest level
-		
-		PopLevelQueue(&mlfq->qLevel1);
-		PushLevelQueue(&mlfq->qLevel0, target); // Push to the level0
+int LevelMLFQ(struct MLFQ* mlfq, struct procParse* pp){
+	if (pp->list != 0 && pp->epoch != mlfq->epoch) {
+		return 0;
 	}
-
-	originalSize = tmpQ.size; // tmpQ's components was highest level queue
-	for (int i = 0; i < originalSize; i++) {
-		target = GetFrontLevelQueue(&tmpQ);
-		
-		/* Initialize tick information */
-		target->usedTick = 0;
-		target->usedQuantumTick = 0;
-		target->level = 0;
-		
-		PopLevelQueue(&tmpQ);
-		PushLevelQueue(&mlfq->qLevel0, target); // Push to the level0
-	}	
+	return pp->level;
 }
 
 void InsertMLFQ(struct MLFQ* mlfq, struct procParse* pp){
@@ -278,9 +232,57 @@ void InsertMLFQ(struct MLFQ* mlfq, struct procParse* pp){
 	pp->stride = 0;
 	pp->pass = 0;
 	pp->ticket = 0;
+	pp->epoch = mlfq->epoch;
 
-	
+#ifdef SCHED_CFS
+	InsertCFS(&mlfq->cfs, pp);
+#else
 	PushLevelQueue(&mlfq->qLevel0, pp);
+#endif
 	mlfq->size++;
 }
 
+/* Take pp out of MLFQ. Nothing to do if it is not in.
+ * Only unlinks it: callers may have given pp its new class
+ * already, so a missed boost must not touch its level or ticks. */
+void RemoveMLFQ(struct MLFQ* mlfq, struct procParse* pp){
+#ifdef SCHED_CFS
+	if (RemoveCFS(&mlfq->cfs, pp)) {
+		mlfq->size--;
+	}
+	return;
+#endif
+
+	if (pp->list == 0) {
+		return;
+	}
+
+	SyncListMLFQ(mlfq, pp);
+	RemoveLevelQueue(pp);
+	mlfq->size--;
+}
+
+/* pp got its first RUNNABLE lwp, or lost its last one.
+ * Move it between the ready and the blocked list of its level. */
+void RequeueMLFQ(struct MLFQ* mlfq, struct procParse* pp){
+#ifdef SCHED_CFS
+	RequeueCFS(&mlfq->cfs, pp);
+	return;
+#endif
+
+	if (pp->list == 0) {
+		return; // Not in MLFQ
+	}
+
+	SyncMLFQ(mlfq, pp);
+	RemoveLevelQueue(pp);
+	PushLevelQueue(GetLevelQueue(mlfq, pp->level), pp);
+}
+
+int QuantumMLFQ(struct MLFQ* mlfq, struct procParse* pp, int level){
+#ifdef SCHED_CFS
+	return pp->cfsSlice;
+#endif
+
+	return GetLevelQueue(mlfq, level)->timeQuantum;
+}
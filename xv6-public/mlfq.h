@@ -2,31 +2,51 @@
 #define MLFQ_H
 
 #include "levelqueue.h"
+#include "cfs.h"
 
 /* Multi-Level-Feedback-Queue
  * MLFQ will be combined with Stride scheduling.
- * So, MLFQ has stride */
+ * So, MLFQ has stride
+ * Built with SCHED_CFS defined (make SCHED=cfs), its processes are
+ * kept in cfs instead of the level queues, all at level 0.
+ * The functions below keep their meaning for callers. */
 struct MLFQ {
-	double pass;
-	double stride;
+	uint64 pass;
+	uint64 stride;
 	unsigned int usedTick;
-	int size;
+	int size; // Processes in all the level queues
+	uint epoch; // Number of boosts so far
 
 	/* It has 3 level queue */
 	struct LevelQueue qLevel0;
 	struct LevelQueue qLevel1;
 	struct LevelQueue qLevel2;
+
+#ifdef SCHED_CFS
+	struct CFS cfs;
+#endif
 };
 
 /* Initialize MLFQ */
 void InitMLFQ(struct MLFQ* mlfq, int ticket); 
 
-/* Return selected process's address.
+/* Return selected process's address, to run on cpu.
  * If there are no selected process, return null. */
-struct procParse* SearchMLFQ(struct MLFQ* mlfq);
+struct procParse* SearchMLFQ(struct MLFQ* mlfq, int cpu);
 
 void BoostMLFQ(struct MLFQ* mlfq); // Priority Boosting
 
+/* pp's level, counting boosts it has not seen yet. -1 for stride */
+int LevelMLFQ(struct MLFQ* mlfq, struct procParse* pp);
+
 void InsertMLFQ(struct MLFQ* mlfq, struct procParse* pp);
 
+void RemoveMLFQ(struct MLFQ* mlfq, struct procParse* pp);
+
+/* Called when pp's number of RUNNABLE lwps becomes or leaves 0 */
+void RequeueMLFQ(struct MLFQ* mlfq, struct procParse* pp);
+
+/* Ticks pp may run at level once picked */
+int QuantumMLFQ(struct MLFQ* mlfq, struct procParse* pp, int level);
+
 #endif // MLFQ_H
@@ -20,9 +20,10 @@
 #define SEG_UCODE 3  // user code
 #define SEG_UDATA 4  // user data+stack
 #define SEG_TSS   5  // this process's task state
+#define SEG_UTLS  6  // this lwp's thread-local storage (%gs)
 
 // cpu->gdt[NSEGS] holds the above segments.
-#define NSEGS     6
+#define NSEGS     7
 
 #ifndef __ASSEMBLER__
 // Segment Descriptor
@@ -98,6 +99,11 @@ struct segdesc {
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
+#define PTE_GUARD       0x200   // Software: not-present guard page
+#define PTE_COW         0x400   // Software: shared, copy on write
+
+// Page fault error code bits
+#define FEC_WR          0x2     // Fault caused by a write
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -0,0 +1,148 @@
+// Page cache.
+//
+// The page cache holds whole pages of program files, so that
+// processes running the same binary map the same physical pages
+// instead of each reading its own copy.
+//
+// Interface:
+// * To get the page at a file offset, call pcacheget.
+//   The caller owns one reference and drops it with kfree.
+// * Writing to or truncating a file calls pcacheinval,
+//   which drops the cache's references to the file's pages.
+//   Processes that already map a page keep the old contents.
+//   ip->pcached tells whether there may be any, so files that
+//   are never mapped are written without looking at the cache.
+//
+// Each cached page holds one reference of its own. When the cache
+// is full, the least recently used page that only the cache refers
+// to is replaced.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;
+  char *page;   // 0 if the entry is unused
+  uint used;    // pcache.clock at the last lookup
+};
+
+struct {
+  struct spinlock lock;
+  uint clock;
+  struct cpage cpage[NPCACHE];
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Find the page of ip at off. Caller holds pcache.lock.
+static struct cpage*
+pcachefind(struct inode *ip, uint off)
+{
+  struct cpage *c;
+
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++)
+    if(c->page && c->dev == ip->dev && c->inum == ip->inum && c->off == off)
+      return c;
+  return 0;
+}
+
+// Return the page holding PGSIZE bytes of ip at offset off,
+// zero past the end of the file, with a reference for the caller.
+// Returns 0 if out of memory or the file can't be read.
+// Caller must hold a reference to ip, but not its lock.
+char*
+pcacheget(struct inode *ip, uint off)
+{
+  struct cpage *c, *victim;
+  char *mem;
+
+  acquire(&pcache.lock);
+  if((c = pcachefind(ip, off)) != 0){
+    c->used = ++pcache.clock;
+    kdup(c->page);
+    release(&pcache.lock);
+    return c->page;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+
+  // Insert while ip is locked, so a concurrent writei
+  // can't invalidate the file before its stale page is cached.
+  ilock(ip);
+  if(readi(ip, mem, off, PGSIZE) < 0){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+
+  acquire(&pcache.lock);
+  if((c = pcachefind(ip, off)) != 0){
+    // Someone else read it meanwhile.
+    c->used = ++pcache.clock;
+    kdup(c->page);
+    release(&pcache.lock);
+    iunlock(ip);
+    kfree(mem);
+    return c->page;
+  }
+
+  victim = 0;
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++){
+    if(c->page == 0){
+      victim = c;
+      break;
+    }
+    if(krefs(c->page) == 1 && (victim == 0 || c->used < victim->used))
+      victim = c;
+  }
+  // Every page is mapped by someone, don't cache this one.
+  if(victim){
+    if(victim->page)
+      kfree(victim->page);
+    victim->dev = ip->dev;
+    victim->inum = ip->inum;
+    victim->off = off;
+    victim->page = mem;
+    victim->used = ++pcache.clock;
+    kdup(mem);
+    ip->pcached = 1;
+  }
+  release(&pcache.lock);
+  iunlock(ip);
+  return mem;
+}
+
+// Drop the cached pages of ip, its contents are changing.
+// Caller must hold ip->lock.
+void
+pcacheinval(struct inode *ip)
+{
+  struct cpage *c;
+
+  if(!ip->pcached)
+    return;
+  acquire(&pcache.lock);
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++){
+    if(c->page && c->dev == ip->dev && c->inum == ip->inum){
+      kfree(c->page);
+      c->page = 0;
+    }
+  }
+  ip->pcached = 0;
+  release(&pcache.lock);
+}
@@ -14,5 +14,9 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       40000  // size of file system in blocks
+#define TLSSIZE      4096  // size of per-thread local storage page
+#define NPCACHE      256  // pages in the program page cache
+#define NSHAREGROUP    8  // stride scheduler share groups
+#define NLENDCHAIN     4  // sleeplock holders followed to lend a turn
 
 #endif // PARAM_H
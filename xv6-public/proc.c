@@ -8,17 +8,24 @@
 #include "spinlock.h"
 #include "mlfq.h"
 #include "stridequeue.h"
+#include "edf.h"
 #include "thread.h"
 #include "ticketbox.h"
+#include "schedtrace.h"
+#include "pstat.h"
+#include "rwlock.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+/* Thread pages are only freed with this held for writing,
+ * so monitoring can walk them without ptable.lock */
+struct rwlock threadDirLock;
+
 /* Information for stride */
 struct TicketBox ticketbox;
-const double CONST_FOR_STRIDE = 0.1;
 
 /* MLFQ */
 struct MLFQ mlfq;
@@ -27,16 +34,24 @@ const int MINIMUM_TICKET_MLFQ = 20;
 /* Stride scheduler */
 struct StrideQueue strideQ;
 
+/* Real-time class */
+struct EDF edf;
+
+/* Gang process in its slice. Until it ends, every cpu picks its
+ * RUNNABLE lwps first. Protected by ptable.lock, see set_gang(). */
+struct {
+	struct procParse* pp; // 0 if there is none
+	uint until; // ticks when the slice ends
+} gang;
+const int GANG_SLICE = 5;
+
 /* procParse table */
 struct procParse ppTable[NPROC];
 
-struct procParse* schedule(void); // To select the runnable process
+struct procParse* schedule(int cpu); // To select the runnable process
 
 /* Time quantums for scheduling */
 extern int TIME_QUANTUM_STRIDE;
-extern int TIME_QUANTUM_LEVEL0;
-extern int TIME_QUANTUM_LEVEL1;
-extern int TIME_QUANTUM_LEVEL2;
 
 static struct proc *initproc;
 
@@ -50,6 +65,7 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  initrwlock(&threadDirLock, "threadDir");
 }
 
 // Must be called with interrupts disabled
@@ -117,6 +133,14 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->waittsc = 0;
+  p->ticks = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  p->lasttick = 0;
+  p->cpumask = ~0;
+  p->cpu = -1;
+  p->group = p;
 
   release(&ptable.lock);
 
@@ -142,14 +166,34 @@ found:
   p->context->eip = (uint)forkret;
 
   // Make main thread
+  // Its lwp is the slot itself, the copy in the thread is not used.
   struct procParse* pp = ppTable + pIndex;
-  struct Thread* t = AllocThread(pp);
+  struct Thread* t;
+  if((t = AllocMainThread(pp)) == 0){
+    kfree(p->kstack);
+    p->kstack = 0;
+    acquire(&ptable.lock);
+    p->state = UNUSED;
+    release(&ptable.lock);
+    return 0;
+  }
+  p->thread = t;
 
   /* Insert new process into MLFQ */
   // and set thread info
   acquire(&ptable.lock);
+  pp->nrunnable = 0;
+  pp->pinned = 0;
+  pp->lastCpu = -1;
+  pp->nice = 0;
+  pp->vruntime = 0;
   InsertMLFQ(&mlfq, pp);
   pp->threadNow = t;
+  pp->lwpShare = 0;
+  pp->lwpPass = 0;
+  pp->gang = 0;
+  pp->nrunning = 0;
+  pp->stopper = 0;
   t->p = p;
   release(&ptable.lock);
 
@@ -177,8 +221,25 @@ userinit(void)
 	ppTable[i].stride = 0;
 	ppTable[i].usedTick = 0;
 	ppTable[i].usedQuantumTick = 0;
-	ppTable[i].lastTick = 0;
 	ppTable[i].level = -1;
+	ppTable[i].nrunning = 0;
+	ppTable[i].lwpShare = 0;
+	ppTable[i].gang = 0;
+	ppTable[i].lwpPass = 0;
+	ppTable[i].nrunnable = 0;
+	ppTable[i].pinned = 0;
+	ppTable[i].lastCpu = -1;
+	ppTable[i].next = 0;
+	ppTable[i].prev = 0;
+	ppTable[i].list = 0;
+	ppTable[i].epoch = 0;
+	ppTable[i].inCFS = 0;
+	ppTable[i].cfsHeight = 0;
+	ppTable[i].rtRuntime = 0;
+	ppTable[i].rtUsed = 0;
+	ppTable[i].shareGroup = 0;
+	ppTable[i].strideQueued = 0;
+	ppTable[i].stopper = 0;
 	ppTable[i].tid = 0;
 	
 	for (int pn = 0; pn < NTHREADPAGE; pn++) {
@@ -188,16 +249,22 @@ userinit(void)
 	InitAddrStack(&ppTable[i].trashAddrStack);
 
 	ppTable[i].execFlag = 0;
+	InitExecMap(&ppTable[i].execMap);
+	initsleeplock(&ppTable[i].lock, "procparse");
+	initlock(&ppTable[i].pglock, "pglock");
+	initlock(&ppTable[i].cwdlock, "cwd");
 
 	i++;
   }	
 
   // Initialize ticketbox
+  initlock(&ticketbox.lock, "ticketbox");
   ticketbox.ticket = 100;
 
   /* Initialize schedulers */
   InitMLFQ(&mlfq, MINIMUM_TICKET_MLFQ);
   InitStrideQueue(&strideQ);
+  InitEDF(&edf);
 
   p = allocproc();
     
@@ -224,7 +291,7 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  setstate(p, RUNNABLE);
 
   release(&ptable.lock);
 }
@@ -235,21 +302,98 @@ int
 growproc(int n)
 {
   uint sz;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
+  struct spinlock *lk = &ppTable[curproc - ptable.proc].pglock;
  
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Pages are allocated lazily by the page fault handler,
+    // only refuse a request that could never be backed.
+    if(sz + n < sz || sz + n >= KERNBASE)
       return -1;
+    if(PGROUNDUP(sz + n) - PGROUNDUP(sz) > (uint)kfreepages() * PGSIZE)
+      return -1;
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    acquire(lk);
+    sz = deallocuvm(curproc->pgdir, sz, sz + n);
+    release(lk);
+    if(sz == 0)
       return -1;
+    shootdown(curproc->pgdir);
   }
   curproc->sz = sz;
-  switchuvm(curproc);
   return 0;
 }
 
+// Resolve a fault on user address va of the current process.
+// write is set for a write access. kernel is set if the fault
+// happened in the kernel, e.g. while a system call copies into
+// a user buffer.
+// Return 0 if the page is accessible now, -1 if the access is bad.
+int
+pagefault(uint va, int write, int kernel)
+{
+  struct proc *curproc = myproc();
+  struct procParse* pp;
+
+  if(curproc == 0)
+    return -1;
+  if(va >= curproc->group->sz){
+    if(!kernel || va >= KERNBASE)
+      return -1;
+    // Another lwp shrank the memory after the system call checked
+    // its user pointer. The access goes to a scratch page the user
+    // can't see, and the process is killed on the way out.
+    curproc->killed = 1;
+    return mapscratch(curproc->pgdir, va);
+  }
+  pp = ppTable + (curproc->group - ptable.proc);
+  return faultin(curproc->pgdir, &pp->execMap, va, write, kernel);
+}
+
+// The current directory, with a reference for the caller.
+struct inode*
+cwddup(void)
+{
+  struct proc *group = myproc()->group;
+  struct procParse *pp = ppTable + (group - ptable.proc);
+  struct inode *ip;
+
+  acquire(&pp->cwdlock);
+  ip = idup(group->cwd);
+  release(&pp->cwdlock);
+  return ip;
+}
+
+// Make ip the current directory, taking over the caller's reference.
+// Returns the old one, for the caller to iput.
+struct inode*
+cwdswap(struct inode *ip)
+{
+  struct proc *group = myproc()->group;
+  struct procParse *pp = ppTable + (group - ptable.proc);
+  struct inode *old;
+
+  acquire(&pp->cwdlock);
+  old = group->cwd;
+  group->cwd = ip;
+  release(&pp->cwdlock);
+  return old;
+}
+
+// Lock of pgdir's user part if it is the current process's page
+// table, 0 for one nobody else uses yet, e.g. a new one in exec().
+struct spinlock*
+pgdirlock(pde_t *pgdir)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pgdir != pgdir)
+    return 0;
+  return &ppTable[p->group - ptable.proc].pglock;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -259,7 +403,8 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
-  struct procParse* curpp = ppTable + (curproc - ptable.proc);
+  struct proc *group = curproc->group; // What the lwps share
+  struct procParse* curpp = ppTable + (group - ptable.proc);
   struct procParse* newpp; // new process's procparse
 
   // Allocate process.
@@ -271,11 +416,17 @@ fork(void)
   // Copy process state from proc.
   // Current process's size can be changed by other threads
   // So must be protected
-  acquire(&ptable.lock);
-
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  acquiresleep(&curpp->lock);
+
+  // Other lwps must not unshare a page while it is being shared
+  acquire(&curpp->pglock);
+  np->pgdir = copyuvm(curproc->pgdir, group->sz);
+  release(&curpp->pglock);
+  if(np->pgdir == 0){
+	releasesleep(&curpp->lock);
 	kfree(np->kstack);
     np->kstack = 0;
+	acquire(&ptable.lock);
     np->state = UNUSED;
 	release(&ptable.lock);
     return -1;
@@ -289,25 +440,47 @@ fork(void)
   	newpp->trashAddrStack.arr[i] = curpp->trashAddrStack.arr[i];
   }
 
-  np->sz = curproc->sz;
+  // Pages the parent never touched are read from the same file
+  DupExecMap(&newpp->execMap, &curpp->execMap);
+
+  np->sz = group->sz;
+  np->tlsbase = curproc->tlsbase; // TLS page is copied at the same address
+  releasesleep(&curpp->lock);
   
-  np->parent = curproc;
+  np->parent = group;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
+  // Other lwps may close files and chdir meanwhile
   for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+    np->ofile[i] = filepin(&group->ofile[i]);
+  np->cwd = cwddup();
 
-  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  safestrcpy(np->name, group->name, sizeof(group->name));
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
-
+  acquire(&ptable.lock);
+  // The child is as nice as its parent, and starts from its vruntime
+  // so that forking does not win cpu time
+  newpp->nice = curpp->nice;
+  // and runs where the forking lwp may
+  np->cpumask = curproc->cpumask;
+  newpp->pinned = curpp->pinned;
+  if (PASSBEFORE(newpp->vruntime, curpp->vruntime)) {
+    newpp->vruntime = curpp->vruntime;
+  }
+  // Members of a share group fork members, which split its share.
+  // If the group can't take it, the child stays in MLFQ.
+  if (curpp->shareGroup != 0 &&
+      JoinShareGroup(newpp, curpp->shareGroup - shareGroups,
+                     curpp->ticket) >= 0) {
+    RemoveMLFQ(&mlfq, newpp);
+  }
+  setstate(np, RUNNABLE);
+  np->readytsc = rdtsc();
   release(&ptable.lock);
 
   return pid;
@@ -320,65 +493,57 @@ void
 exit(void)
 {
   struct proc *curproc = myproc();
+  struct proc *group = curproc->group;
+  struct procParse* pp = ppTable + (group - ptable.proc);
   struct proc *p;
   int fd;
 
-  if(curproc == initproc)
+  if(group == initproc)
     panic("init exiting");
 
+  // Take the other lwps down first, they use the files too.
+  // If another lwp is already doing that, just go.
+  acquire(&ptable.lock);
+  if(StopLWPs(pp) < 0){
+    curproc->state = ZOMBIE;
+    sched();
+    panic("zombie exit");
+  }
+  release(&ptable.lock);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
+    if(group->ofile[fd]){
+      fileclose(group->ofile[fd]);
+      group->ofile[fd] = 0;
     }
   }
 
   begin_op();
-  iput(curproc->cwd);
+  iput(group->cwd);
+  FreeExecMap(&pp->execMap);
   end_op();
-  curproc->cwd = 0;
+  group->cwd = 0;
 
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup1(group->parent);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
+    if(p->parent == group){
       p->parent = initproc;
-      if(p->state == ZOMBIE)
+      if(LiveLWP(ppTable + (p - ptable.proc)) == 0)
         wakeup1(initproc);
     }
   }
 
   // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE;
-
-  // Before jumping, Make all lwps to the ZOMBIE
-  struct procParse* pp = ppTable + (curproc - ptable.proc);
-  struct ThreadPage* pg = 0;
-  struct Thread* t = 0;
-  for (int pn = 0; pn < NTHREADPAGE; pn++) {
-      pg = pp->threadDir[pn];
-	  
-	  if (pg == 0) {
-	  	continue;
-	  }
-
-	  for (int i = 0; i < NTHREAD; i++) {
-	      t = &(pg->threadArr[i]);
-
-		  if (t->p != 0) {
-		      t->p->state = ZOMBIE;
-		  }
-	  }
-  }
-
+  // The other lwps are ZOMBIE already, so this was the last one.
   // Even if this process scheduled by stride queue,
   // It is no necessary to push again into stride queue.
-  // Because this process call exit, all lwp is ZOMBIE
+  curproc->state = ZOMBIE;
   sched();
   panic("zombie exit");
 }
@@ -391,17 +556,19 @@ wait(void)
   struct proc *p;
   int havekids, pid;
   struct proc *curproc = myproc();
+  struct proc *group = curproc->group;
   
   acquire(&ptable.lock);
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != group)
         continue;
       havekids = 1;
-      if(p->state == ZOMBIE){
-		struct procParse* pp = ppTable + (p - ptable.proc);
+      // Exited when all of its lwps have
+      struct procParse* pp = ppTable + (p - ptable.proc);
+      if(LiveLWP(pp) == 0){
   
   		// Initialize address stack
   		int size = pp->trashAddrStack.size;
@@ -413,6 +580,7 @@ wait(void)
 		// user stack will be deallocated at freevm()
   		struct ThreadPage* pg = 0;
   		struct Thread* t = 0;
+		acquirewrite(&threadDirLock);
 		for(int pn = 0; pn < NTHREADPAGE; pn++) {
   			pg = pp->threadDir[pn];
 
@@ -435,12 +603,27 @@ wait(void)
 				pp->threadDir[pn] = 0;
 			}
  		}
+		releasewrite(&threadDirLock);
 
   		// Initailize tid
   		pp->tid = 0;
 
 		// make exec flag 0
 		pp->execFlag = 0;
+		pp->stopper = 0;
+
+		// Dead processes stay in MLFQ's blocked lists until now
+		RemoveMLFQ(&mlfq, pp);
+		if (pp->level == -1) {
+			LeaveStride(pp);
+		}
+		else if (pp->level == LEVEL_EDF) {
+			RemoveEDF(&edf, pp);
+		}
+		pp->gang = 0;
+		if (gang.pp == pp) {
+			gang.pp = 0;
+		}
 
         // Found one.
         pid = p->pid;
@@ -465,7 +648,7 @@ wait(void)
     }
 
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    sleep(group, &ptable.lock);  //DOC: wait-sleep
   }
 }
 
@@ -481,10 +664,13 @@ void
 scheduler(void)
 {
   struct cpu *c = mycpu();
+  int cpu = cpuid();
   c->proc = 0;
 
   struct procParse* pp = 0;
+  struct procParse* lender = 0;
   struct proc* p = 0;
+  uint64 wait;
 	
   for(;;){
 	// Enable interrupts on this processor.
@@ -492,75 +678,73 @@ scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
-    
-	// It is possible that ptable's proc is SLEEPING
-	// but another lwp in the same process can be RUNNABLE.
-	// Upload RUNNABLE lwp to the ptable's proc
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-		if (p->state == UNUSED) {
-			continue;
-		}
 
-		pp = ppTable + (p - ptable.proc);
-		swap(pp, RUNNABLE); // swap ptable's proc to the RUNNABLE lwp
+	// Pick a process, then one of its RUNNABLE lwps.
+	// Its other lwps can run on other cpus at the same time.
+	pp = schedule(cpu);
+
+	// A process waiting for a sleeplock lends its turn to the holder
+	lender = 0;
+	if (pp != 0 && (p = PickLWP(pp, pp->threadNow, cpu)) == 0 &&
+		(p = LentLWP(pp, cpu)) != 0) {
+		lender = pp;
+		lender->nrunning++;
+		pp = ppTable + (p->group - ptable.proc);
+		TraceSched(TRACE_LEND, p->pid, p->thread->tid,
+				   lender->p->pid, 0);
 	}
 
-	pp = schedule();
+	if (pp != 0 && p != 0) {	
+		c->lender = lender;
+		pp->threadNow = p->thread;
+		pp->nrunning++;
+		pp->lastCpu = cpu;
+		p->cpu = cpu;
+		c->proc = p;
+		wait = rdtsc() - p->readytsc;
+		p->waittsc += wait;
+		TraceSched(TRACE_PICK, p->pid, p->thread->tid, pp->level,
+				   (uint)wait);
 
-	if (pp != 0) {	
-		c->proc = pp->p;
+		switchuvm(p);
 
-		switchuvm(c->proc);
+		setstate(p, RUNNING);
 
-		c->proc->state = RUNNING;
-
-		swtch(&(c->scheduler), c->proc->context);
+		swtch(&(c->scheduler), p->context);
 
 		switchkvm();
 
-		pp = ppTable + (c->proc - ptable.proc);
+		// sched2() may have switched to another lwp of the same process
+		pp = ppTable + (c->proc->group - ptable.proc);
+		pp->nrunning--;
+		pp->lastTick = ticks;
 
-		// If process that switched into scheduler is ZOMBIE,
-		// It means that there are no RUNNALBE lwp in the same group.
-		// Because if there are RUNNALBE lwp, 
-		// switching between scheduler is not possible.
-		// So, two case is possible
-		
-		// 1. SLEEPING lwp exists
-		// In this case, ptable's proc must be replaced to SLEEPING lwp
-		// If ptable's proc is not replaced, scheduler will
-		// remove this process because ptable's proc is ZOMBIE
-		
-		// 2. No SLEEPING lwp
-		// In this case, process's all lwps are ZOMBIE
-		// this process will be removed by scheudler
-
-		// cf. switching between ZOMBIE proc in ptable
-		// with SLEEPING proc in other thread's lwp 
-		// must be occured in scheduler.
-		// If this occur in ZOMBIE's context(e.g sched2)
-		// SLEEPING proc will have ZOMBIE'S context
-		// (More detail)
-		// ptable <-----------------> thread 1 (ZOMBIE)
-		//                            thread 2 (SLEEPING)
-		//                   
-		//                            thread 1 (ZOMBIE)
-		// ptable <-----------------> thread 2 (SLEEPING)
-		// If this happen in sched2, ptable's proc is thread 2
-		// But context is still thread1
-		// then sched() will be called, come to scheduler.
-		// swtch(&(c->scheduler), c->proc->context) is called
-		// But ptable's context is thread 1's context
-		// Go back to the ZOMBIE's context => error
-		if (c->proc->state == ZOMBIE) {
-			pp = ppTable + (c->proc - ptable.proc);
-
-			// Swap ptable's proc to the SLEEPING lwp
-			swap(pp, SLEEPING);
+		// An lwp exiting or execing waits for the others to get off
+		if (pp->stopper != 0) {
+			wakeup1(&pp->stopper);
+		}
+
+		// A stride process is out of the queue while it runs.
+		// Once its last lwp left the cpu, push it again with its new pass.
+		if (pp->level == -1 && pp->nrunning == 0 && LiveLWP(pp) != 0) {
+			PushStrideQueue(GetStrideQueue(pp), pp);
+		}
+
+		// So is one that lent its turn, charged for it by addticks()
+		if ((lender = c->lender) != 0) {
+			c->lender = 0;
+			lender->nrunning--;
+			if (lender->level == -1 && lender->nrunning == 0 &&
+				LiveLWP(lender) != 0) {
+				PushStrideQueue(GetStrideQueue(lender), lender);
+			}
 		}
 		
 		c->proc = 0;
 	}
+	else if (pp != 0 && pp->level == -1) {
+		PushStrideQueue(GetStrideQueue(pp), pp);
+	}
 
     release(&ptable.lock);
   }
@@ -594,6 +778,25 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Change lwp p's state. Every change into or out of RUNNABLE
+// goes through here, which counts the process's RUNNABLE lwps
+// so that MLFQ only lists the processes that can run.
+// Caller must hold ptable.lock.
+void
+setstate(struct proc *p, int state)
+{
+  struct procParse* pp = ppTable + (p->group - ptable.proc);
+
+  if(p->state == RUNNABLE && state != RUNNABLE){
+    if(--pp->nrunnable == 0)
+      RequeueMLFQ(&mlfq, pp);
+  } else if(p->state != RUNNABLE && state == RUNNABLE){
+    if(pp->nrunnable++ == 0)
+      RequeueMLFQ(&mlfq, pp);
+  }
+  p->state = state;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
@@ -601,18 +804,12 @@ yield(void)
   acquire(&ptable.lock);  //DOC: yieldlock
   
   struct proc* p = myproc();
-  struct procParse* pp = ppTable + (p - ptable.proc);
 
-  p->state = RUNNABLE;
-
-  // Before go to the scheduler,
-  // Check who scheduled this process
-  // If this process is scheduled by stride queue,
-  // Push this process again to the stride queue with changed pass
-  if (pp->level == -1) {
-	  PushStrideQueue(&strideQ, pp);
-  }
+  setstate(p, RUNNABLE);
+  p->readytsc = rdtsc();
 
+  // A stride process is pushed again to the stride queue
+  // by the scheduler, once none of its lwps runs any more.
   sched();
 
   release(&ptable.lock);
@@ -665,6 +862,8 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->nvcsw++;
+  TraceSched(TRACE_SLEEP, p->pid, p->thread->tid, 0, 0);
 
   // Do not go to the scheduler immediately
   // At first, go to the same lwp group
@@ -707,7 +906,9 @@ wakeup1(void *chan)
 					continue;
 				}
 				else if (t->p->state == SLEEPING && t->p->chan == chan) {
-					t->p->state = RUNNABLE;
+					setstate(t->p, RUNNABLE);
+					t->p->readytsc = rdtsc();
+					TraceSched(TRACE_WAKEUP, t->p->pid, t->tid, 0, 0);
 				}
 
 			}
@@ -733,19 +934,40 @@ kill(int pid)
 {
   struct proc *p;
 
+  // Find the slot without the lock. Pids are never reused,
+  // so a slot that still has pid under the lock is the process.
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid)
+      break;
+  if(p == &ptable.proc[NPROC])
+    return -1;
+
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
+  if(p->pid != pid){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->killed = 1;
+  // Every lwp exits on its way back to user space.
+  // Wake them from sleep if necessary.
+  struct procParse* pp = ppTable + (p - ptable.proc);
+  struct Thread* t;
+  for (int pn = 0; pn < NTHREADPAGE; pn++) {
+    if (pp->threadDir[pn] == 0)
+      continue;
+    for (int i = 0; i < NTHREAD; i++) {
+      t = &(pp->threadDir[pn]->threadArr[i]);
+      if (t->p == 0)
+        continue;
+      t->p->killed = 1;
+      if(t->p->state == SLEEPING){
+        setstate(t->p, RUNNABLE);
+        t->p->readytsc = rdtsc();
+      }
     }
   }
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -785,10 +1007,68 @@ procdump(void)
   }
 }
 
+// Fill ps with the accounting of up to n lwps, grouped by process.
+// Returns the number of entries filled.
+// Runs without ptable.lock so it never holds up the scheduler,
+// so an entry can mix values from before and after a change.
+int
+getpstat(struct PStat* ps, int n)
+{
+	struct proc* p;
+	struct procParse* pp;
+	struct ThreadPage* pg;
+	struct Thread* t;
+	struct PStat* s;
+	int cnt = 0;
+
+	acquireread(&threadDirLock);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+		if (p->state == UNUSED) {
+			continue;
+		}
+		pp = ppTable + (p - ptable.proc);
+
+		for (int pn = 0; pn < NTHREADPAGE; pn++) {
+			if ((pg = pp->threadDir[pn]) == 0) {
+				continue;
+			}
+			for (int i = 0; i < NTHREAD; i++) {
+				t = &(pg->threadArr[i]);
+				if (t->p == 0) {
+					continue;
+				}
+				if (cnt == n) {
+					goto done;
+				}
+
+				s = ps + cnt++;
+				s->pid = p->pid;
+				s->ppid = p->parent ? p->parent->pid : 0;
+				s->tid = t->tid;
+				s->state = t->p->state;
+				s->cpu = t->p->cpu;
+				s->level = LevelMLFQ(&mlfq, pp);
+				safestrcpy(s->name, p->name, sizeof(s->name));
+				s->ticket = pp->ticket;
+				s->pass = (uint)(pp->pass / STRIDE1);
+				s->usedTick = pp->usedTick;
+				s->ticks = t->p->ticks;
+				s->nvcsw = t->p->nvcsw;
+				s->nivcsw = t->p->nivcsw;
+				s->waittsc = t->p->waittsc;
+			}
+		}
+	}
+done:
+	releaseread(&threadDirLock);
+
+	return cnt;
+}
+
 int
 getppid(void)
 {
-	return myproc()->parent->pid;
+	return myproc()->group->parent->pid;
 }
 
 int
@@ -797,41 +1077,49 @@ getlev(void)
 	/* Get the process's level.
 	 * If process is managed by stride scheduler,
 	 * process's level is -1 */
-	int pIndex = myproc() - ptable.proc;
+	int pIndex = myproc()->group - ptable.proc;
 	struct procParse* pp = ppTable + pIndex;
 
-	return pp->level;
+	return LevelMLFQ(&mlfq, pp);
 }
 
 int
 set_cpu_share(void)
 {
 	int ret = 0;
-	int pIndex = myproc() - ptable.proc;
+	int pIndex = myproc()->group - ptable.proc;
 	struct procParse* pp = ppTable + pIndex;
 
 	int ticket;
 	argint(0, &ticket); // Bring the first argument.
 
+	/* A member of a share group goes back to MLFQ first.
+	 * Its tickets were of the group, not of the whole cpu.
+	 * So does a real-time task, whose tickets bound its deadlines. */
+	acquire(&ptable.lock);
+	if (pp->shareGroup != 0) {
+		LeaveStride(pp);
+		InsertMLFQ(&mlfq, pp);
+	}
+	else if (pp->level == LEVEL_EDF) {
+		RemoveEDF(&edf, pp);
+		InsertMLFQ(&mlfq, pp);
+	}
+	release(&ptable.lock);
+
 	/* If required ticket is 0 */
 	if (ticket == 0) {
 		/* If this process is scheduled by stride scheduler,
 		 * move it to the mlfq and give ticket back to the g_ticket.
 		 * If this process is scheduled by mlfq, do nothing. */
+		acquire(&ptable.lock);
 		if (pp->level == -1) {
-			acquire(&ticketbox.lock);
-			ticketbox.ticket += pp->ticket;
-			release(&ticketbox.lock);
-
-			pp->ticket = 0;
+			LeaveStride(pp);
 
-			/* InsertMLFQ make pp's level to the 0.
-			 * So this process will be removed at SearchStrideQueue.
-			 * Because this process's level is not -1. */
-			acquire(&ptable.lock);
+			/* InsertMLFQ make pp's level to the 0. */
 			InsertMLFQ(&mlfq, pp);
-			release(&ptable.lock);
 		}
+		release(&ptable.lock);
 
 		return 0;
 	}
@@ -840,71 +1128,264 @@ set_cpu_share(void)
 	// Must determine the process's fisrt pass.
 	// This will be determined by comparing
 	// MLFQ's pass and stride scheduler's minimum pass.
+	acquire(&ptable.lock);
+	uint64 minPass = MinPassStride(mlfq.pass);
+
+	ret = InsertStrideQueue(&strideQ, pp, ticket, minPass);
+	if (ret == 0) {
+		RemoveMLFQ(&mlfq, pp); // Now managed by stride scheduler
+	}
+	release(&ptable.lock);
+
+	return ret;
+}
+
+// Give lwp tid of the calling process share percent of the
+// process's cpu time, or none if share is 0. The shares of a
+// process's lwps add up to 100 at most. Returns 0, or -1.
+int
+set_lwp_share(int tid, int share)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	struct Thread* t;
+	int ret = -1;
+
+	if (share < 0 || share > 100) {
+		return -1;
+	}
 
-	/* Get minimum pass of stride scheduler.
-	 * But if process is dead, remove it and select again. */
 	acquire(&ptable.lock);
-	double minPass = -1;
-	int originalSize = strideQ.size;
-	struct procParse* top = 0;
-	for (int i = 0; i < originalSize; i++) {
-		top = GetTopStrideQueue(&strideQ);
-
-		/* If process is dead, remove it. */
-		if (top->p->state == UNUSED || top->p->state == ZOMBIE) {
-			/* Give ticket back to global ticket */
-			acquire(&ticketbox.lock);
-			ticketbox.ticket += top->ticket;
-			release(&ticketbox.lock);
-
-			/* Initialize top */
-			top->pass = 0;
-			top->stride = 0;
-			top->ticket = 0;
-			top->usedTick = 0;
-			top->usedQuantumTick = 0;
-			top->level = -1;
-
-			PopStrideQueue(&strideQ);
+	for (int pn = 0; pn < NTHREADPAGE && ret < 0; pn++) {
+		if (pp->threadDir[pn] == 0) {
+			continue;
 		}
-		else {
-			/* Regardless of whether process is runnable or not,
-			 * Just get the minimum pass */
-			minPass = top->pass;
+		for (int i = 0; i < NTHREAD; i++) {
+			t = &(pp->threadDir[pn]->threadArr[i]);
+			if (t->p == 0 || t->tid != tid ||
+				t->p->state == UNUSED || t->p->state == ZOMBIE) {
+				continue;
+			}
+
+			if (pp->lwpShare - t->share + share <= 100) {
+				pp->lwpShare += share - t->share;
+				t->share = share;
+				ret = 0;
+			}
 			break;
 		}
 	}
+	release(&ptable.lock);
 
-	/* If stride scheduler has no process */
-	if (minPass == -1) {
-		minPass = mlfq.pass; // Set the min pass to the MLFQ's pass
+	return ret;
+}
+
+// Let lwp tid of the calling process, or all of its lwps if tid is -1,
+// run only on the cpus in mask, bit i for cpu i. An lwp on a cpu left
+// out moves at the next tick. New lwps and forked processes get the
+// mask of the lwp creating them. Returns 0, or -1 if there is no lwp
+// tid or no cpu in mask.
+int
+set_affinity(int tid, int mask)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	uint online = (1 << ncpu) - 1;
+	struct Thread* t;
+	int ret = -1;
+
+	if ((mask & online) == 0) {
+		return -1;
 	}
-	/* If stride scheduler has process */
-	else {
-		minPass = minPass <= mlfq.pass ? minPass : mlfq.pass;
-		// Choose lower pass
+
+	acquire(&ptable.lock);
+	pp->pinned = 0;
+	for (int pn = 0; pn < NTHREADPAGE; pn++) {
+		if (pp->threadDir[pn] == 0) {
+			continue;
+		}
+		for (int i = 0; i < NTHREAD; i++) {
+			t = &(pp->threadDir[pn]->threadArr[i]);
+			if (t->p == 0 ||
+				t->p->state == UNUSED || t->p->state == ZOMBIE) {
+				continue;
+			}
+
+			if (tid == -1 || t->tid == tid) {
+				t->p->cpumask = mask & online;
+				ret = 0;
+			}
+			if ((t->p->cpumask & online) != online) {
+				pp->pinned = 1;
+			}
+		}
 	}
+	release(&ptable.lock);
 
-	ret = InsertStrideQueue(&strideQ, pp, ticket, minPass);
+	return ret;
+}
+
+// Make a share group of ticket tickets of the whole cpu, and move
+// the calling process into it. Its children join the group too.
+// Returns the group's id, or -1.
+int
+share_group(int ticket)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	int gid;
+
+	if (ticket <= 0) {
+		return -1;
+	}
+
+	acquire(&ptable.lock);
+	if (pp->level == LEVEL_EDF) {
+		RemoveEDF(&edf, pp);
+		InsertMLFQ(&mlfq, pp);
+	}
+	gid = MakeShareGroup(ticket, MinPassStride(mlfq.pass));
+	if (gid >= 0) {
+		RemoveMLFQ(&mlfq, pp);
+		JoinShareGroup(pp, gid, 1);
+	}
+	release(&ptable.lock);
+
+	return gid;
+}
+
+// Move the calling process into share group gid, where it gets
+// ticket tickets of the group's share. Returns gid, or -1.
+int
+join_share_group(int gid, int ticket)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	int level;
+	int ret;
+
+	acquire(&ptable.lock);
+	if (pp->level == LEVEL_EDF) {
+		RemoveEDF(&edf, pp);
+		InsertMLFQ(&mlfq, pp);
+	}
+	level = pp->level;
+	if ((ret = JoinShareGroup(pp, gid, ticket)) >= 0 && level != -1) {
+		RemoveMLFQ(&mlfq, pp);
+	}
+	release(&ptable.lock);
+
+	return ret;
+}
+
+// Move the calling process into the real-time class, where it may
+// run runtime ticks of every period ticks, by deadline ticks into
+// the period. A runtime of 0 moves it back to MLFQ. A stride process
+// leaves the stride scheduler once it is admitted, and keeps its share
+// if it is not. Returns 0, or -1.
+int
+set_realtime(int runtime, int period, int deadline)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	int ret = 0;
+
+	acquire(&ptable.lock);
+	if (runtime == 0) {
+		if (pp->level == -1) {
+			LeaveStride(pp);
+			InsertMLFQ(&mlfq, pp);
+		}
+		else if (pp->level == LEVEL_EDF) {
+			RemoveEDF(&edf, pp);
+			InsertMLFQ(&mlfq, pp);
+		}
+	}
+	else if ((ret = InsertEDF(&edf, pp, runtime, period, deadline,
+							  ticks)) == 0) {
+		RemoveMLFQ(&mlfq, pp); // Now in the real-time class
+	}
 	release(&ptable.lock);
 
 	return ret;
 }
 
+// Set the calling process's nice level, from -20 to 19. A lower one
+// gets more of the cpu in the CFS class, MLFQ does not look at it.
+// Returns 0, or -1.
+int
+set_nice(int nice)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+
+	if (nice < NICE_MIN || nice > NICE_MAX) {
+		return -1;
+	}
+
+	acquire(&ptable.lock);
+	pp->nice = nice;
+	release(&ptable.lock);
+
+	return 0;
+}
+
+// Schedule the lwps of the calling process together, or not if on is
+// 0. Once it is picked, its slice of GANG_SLICE ticks starts: every
+// cpu that may run one of its RUNNABLE lwps picks it first, and other
+// processes give those cpus up at the next tick. So lwps waiting for
+// each other do not wait for a peer that is not running. Returns 0.
+int
+set_gang(int on)
+{
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+
+	acquire(&ptable.lock);
+	pp->gang = on != 0;
+	if (!pp->gang && gang.pp == pp) {
+		gang.pp = 0;
+	}
+	release(&ptable.lock);
+
+	return 0;
+}
+
+// The gang in its slice, if it has an lwp to run on cpu.
+// A stride gang is only joined while it is out of its queue,
+// that is while one of its lwps runs. Caller holds ptable.lock.
+static struct procParse*
+gangpick(int cpu)
+{
+	struct procParse* pp = gang.pp;
+
+	if (pp != 0 && (!TICKBEFORE(ticks, gang.until) || !pp->gang ||
+					pp->level == LEVEL_EDF)) {
+		gang.pp = pp = 0; // Its slice is over
+	}
+	if (pp == 0 || pp->nrunnable == 0 || !RunnableOn(pp, cpu) ||
+		(pp->level == -1 && pp->nrunning == 0)) {
+		return 0;
+	}
+	return pp;
+}
+
 struct procParse*
-schedule(void)
+schedule(int cpu)
 {
 	struct procParse* pp = 0;
+	uint64 pass = 0; // Stride scheduler's pass to compare with MLFQ's
 	
+	/* Real-time tasks with runtime left go before both schedulers */
+	if ((pp = SearchEDF(&edf, ticks, cpu)) != 0) {
+		pp->usedQuantumTick = 0;
+	}
+	/* Then the lwps of a gang in its slice */
+	else if ((pp = gangpick(cpu)) != 0) {
+		// Its slice is charged as one quantum
+	}
 	/* If both scheduler have no process */
-	if (mlfq.size == 0 && strideQ.size == 0) {
+	else if (mlfq.size == 0 && EmptyStride()) {
 		// Do nothing
 	}
-	else if (strideQ.size == 0) {
+	else if (EmptyStride()) {
 		/* If stride scheduler has no process,
 		 * Select the process from MLFQ. */
 
-		pp = SearchMLFQ(&mlfq);
+		pp = SearchMLFQ(&mlfq, cpu);
 		
 		// It is possible that MLFQ has process but no runnable process.
 		// In this case, do nothing.
@@ -913,7 +1394,7 @@ schedule(void)
 		/* IF MLFQ has no process,
 		 * Select the process from stride scheduler. */
 
-		pp = SearchStrideQueue(&strideQ);
+		pp = SearchStride(&pass, cpu);
 
 		/* If stride scheduler has runnable process */
 		if (pp != 0) {
@@ -930,15 +1411,15 @@ schedule(void)
 
 		/* Get the process who has lowest pass and runnable
 		 * in the stride scheduler */
-		pp = SearchStrideQueue(&strideQ);
+		pp = SearchStride(&pass, cpu);
 
 		if (pp == 0) {
 			/* If stride scheduler has process
 			 * But there are no runnable process,
 			 * Change to MLFQ */
-			pp = SearchMLFQ(&mlfq);
+			pp = SearchMLFQ(&mlfq, cpu);
 		}
-		else if (pp->pass <= mlfq.pass) {
+		else if (!PASSBEFORE(mlfq.pass, pass)) {
 			/* Stride scheduler has runnable process and has lower pass.*/
 			pp->usedQuantumTick = 0;
 		}
@@ -950,13 +1431,13 @@ schedule(void)
 			struct procParse* tmp = pp;
 
 			/* Change process to MLFQ's process */
-			pp = SearchMLFQ(&mlfq);
+			pp = SearchMLFQ(&mlfq, cpu);
 
 			if (pp != 0) {
 				/* If mlfq has runnable process,
 				 * Stride Scheduler's process does not need anymore.
 				 * Push it again */
-				PushStrideQueue(&strideQ, tmp);
+				PushStrideQueue(GetStrideQueue(tmp), tmp);
 			}
 			else {
 				/* If MLFQ has no runnable process,
@@ -969,13 +1450,19 @@ schedule(void)
 		}
 	}
 
+	/* A gang picked in its turn starts its slice */
+	if (pp != 0 && pp->gang && pp->level != LEVEL_EDF && gang.pp == 0) {
+		gang.pp = pp;
+		gang.until = ticks + GANG_SLICE;
+	}
+
 	return pp;
 }
 
 int 			
 thread_create(void) {
 	struct proc* curproc = myproc();
-	struct procParse* pp = ppTable + (curproc - ptable.proc);
+	struct procParse* pp = ppTable + (curproc->group - ptable.proc);
 	struct ThreadId retId;
 
 	/* Get user mode's arguments */
@@ -1011,8 +1498,8 @@ thread_create(void) {
 void
 thread_exit() {
   struct proc *curproc = myproc();
-  struct procParse* pp = ppTable + (curproc - ptable.proc);
-  struct Thread* curthread = pp->threadNow;
+  struct procParse* pp = ppTable + (curproc->group - ptable.proc);
+  struct Thread* curthread = curproc->thread;
  
   acquire(&ptable.lock);
 
@@ -1022,29 +1509,41 @@ thread_exit() {
   	panic("thread_exit argument 0 err\n");
   }
 
+  // The last lwp takes the process with it
+  if (LiveLWP(pp) == 1) {
+  	release(&ptable.lock);
+	exit();
+  }
+
   // Give argument data to thread
   curthread->retval = arg;
 
+  // Its share goes back to the lwps without one
+  pp->lwpShare -= curthread->share;
+  curthread->share = 0;
+
   // Threads joining this thread might be SLEEPING.
   struct Thread* t = curthread->head;
   while (t != 0) {
-  	t->p->state = RUNNABLE; // Make it RUNNABLE
+	if (t->p->state == SLEEPING) {
+  		setstate(t->p, RUNNABLE); // Make it RUNNABLE
+		t->p->readytsc = rdtsc();
+	}
 	t = t->next;
   }
 
   // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE; // curproc is ptable's proc
+  curproc->state = ZOMBIE;
   sched2();
   panic("zombie thread exit");
 }
 
 int
 thread_join() {
-	struct procParse* pp = ppTable + (myproc() - ptable.proc);
-	struct Thread* curthread = pp->threadNow;
+	struct procParse* pp = ppTable + (myproc()->group - ptable.proc);
+	struct Thread* curthread = myproc()->thread;
 	struct Thread* target = 0;
-
-	acquire(&ptable.lock);
+	void* rv;
 	
 	// Get argument of thread_join system call
 	struct ThreadId argId;
@@ -1057,6 +1556,14 @@ thread_join() {
 		panic("thread_join argument 1 err\n");
 	}
 
+	// retval is written once ptable.lock is released, as a fault
+	// may read the program file. Check it can be written first.
+	if (retval != 0 && argout(1, (char**)&retval, sizeof(*retval)) < 0) {
+		return -1;
+	}
+
+	acquire(&ptable.lock);
+
 	// User want to join argId's thread
 	int pn = argId.pageNum;
 	unsigned int i = argId.tid % NTHREAD;
@@ -1084,16 +1591,20 @@ thread_join() {
 
 	  	// If target is not ZOMBIE, go to SLEEP
 		// else just get target's return value and go back to user code
-		if (target->p->state != ZOMBIE) {
+		while (target->p->state != ZOMBIE) {
+			// Woken by kill(), the process is exiting
+			if (curthread->p->killed) {
+				release(&ptable.lock);
+				return -1;
+			}
   			curthread->p->state = SLEEPING;
+  			curthread->p->nvcsw++;
   			sched2();
 		}
 	}
 
-	// If retval is required, give it.
-	if (retval != 0) {
-		*retval = target->retval; // *(void**) = void*
-	}
+	// Target's return value, given after the lock is released
+	rv = target->retval;
 
 	// If this thread is tail of target
 	// Remove target
@@ -1102,31 +1613,73 @@ thread_join() {
 			panic("thread_join: why target is not ZOMBIE?\n");
 		}
 
+		// FreeThread takes ptable.lock again where it needs it
+		release(&ptable.lock);
+		acquiresleep(&pp->lock);
 		if (FreeThread(pp, target) == -1) {
-			release(&ptable.lock);
+			releasesleep(&pp->lock);
 			cprintf("thread_join err: FreeThread failed\n");
 			return -1;
 		}
+		releasesleep(&pp->lock);
+	}
+	else {
+		release(&ptable.lock);
+	}
+
+	// If retval is required, give it.
+	if (retval != 0) {
+		*retval = rv; // *(void**) = void*
 	}
-	
-	release(&ptable.lock);
 
 	return 0;
 }
 
+// Process whose turn the calling lwp runs in. Its own, unless it holds
+// a sleeplock another process waits for, see LentLWP().
+static struct procParse*
+turnproc(void)
+{
+	struct procParse* pp;
+
+	pushcli();
+	if ((pp = mycpu()->lender) == 0) {
+		pp = ppTable + (myproc()->group - ptable.proc);
+	}
+	popcli();
+	return pp;
+}
+
+// Charge the running lwp and its process for the tick.
+// Lwps of one process, and members of one share group, are charged
+// on several cpus at once. The 64-bit passes are not updated
+// atomically, so charging holds ptable.lock, as the scheduler
+// holds it to read them.
 void
 addticks(uint lastTick) {
-	struct procParse* pp = ppTable + (myproc() - ptable.proc);
+	struct proc* p = myproc();
+	struct procParse* pp = turnproc(); // Charged for this tick
 
-	/* If this tick is already updated */
-	if (pp->lastTick >= lastTick) {
+	/* If this tick is already charged to this lwp.
+	 * Lwps on different cpus are each charged. */
+	if (p->lasttick >= lastTick) {
 		return;
 	}
 
+	acquire(&ptable.lock);
+
 	// If process managed by stride scheduler
 	if (pp->level == -1) {
 		pp->pass += pp->stride;
 		pp->usedQuantumTick += 1;
+		if (pp->shareGroup != 0) {
+			pp->shareGroup->pass += pp->shareGroup->stride;
+		}
+	}
+	// If process is a real-time task, it only uses its runtime
+	else if (pp->level == LEVEL_EDF) {
+		pp->rtUsed += 1;
+		pp->usedQuantumTick += 1;
 	}
 	// If process managed by mlfq
 	else {
@@ -1134,19 +1687,58 @@ addticks(uint lastTick) {
 		pp->usedQuantumTick += 1;
 		mlfq.usedTick += 1;
 		mlfq.pass += mlfq.stride;
+#ifdef SCHED_CFS
+		ChargeCFS(pp);
+#endif
+	}
+	// Charge the lwp's share inside the process
+	if (pp->lwpShare != 0 && pp->p == p->group) {
+		p->thread->pass += p->thread->stride;
 	}
-	pp->lastTick = lastTick; // To prevent overlapping addition
+	p->lasttick = lastTick; // To prevent overlapping addition
+	p->ticks += 1; // Charge the running lwp
+	release(&ptable.lock);
 }
 
 int
 checkquantum() {
-	struct procParse* pp = ppTable + (myproc() - ptable.proc);
+	struct procParse* pp = turnproc();
+	int level = LevelMLFQ(&mlfq, pp); // Boosted since it was picked?
+	struct procParse* rt;
+	int preempt = 0;
+
+	// A lent turn ends once the lender can run itself
+	if (pp->p != myproc()->group && pp->nrunnable != 0) {
+		return 1;
+	}
+
+	// An lwp that may no longer run on this cpu moves
+	if ((myproc()->cpumask & (1 << cpuid())) == 0) {
+		return 1;
+	}
+
+	// A real-time task waiting preempts anything but an earlier deadline,
+	// and a gang in its slice anything but itself and real-time tasks.
+	// Without either, ptable.lock is not taken every tick.
+	if (edf.size != 0 || gang.pp != 0) {
+		acquire(&ptable.lock);
+		rt = SearchEDF(&edf, ticks, cpuid());
+		preempt = rt != 0 && (level != LEVEL_EDF ||
+							  TICKBEFORE(RTDEADLINE(rt), RTDEADLINE(pp)));
+		if (!preempt && level != LEVEL_EDF && gang.pp != pp) {
+			preempt = gangpick(cpuid()) != 0;
+		}
+		release(&ptable.lock);
+	}
+	if (preempt) {
+		return 1;
+	}
 
-	// If process used all time quantum
-	if ((pp->level == -1 && pp->usedQuantumTick >= TIME_QUANTUM_STRIDE)
-		|| (pp->level == 0 && pp->usedQuantumTick >= TIME_QUANTUM_LEVEL0)
-		|| (pp->level == 1 && pp->usedQuantumTick >= TIME_QUANTUM_LEVEL1)
-		|| (pp->level == 2 && pp->usedQuantumTick >= TIME_QUANTUM_LEVEL2)
+	// If process used all time quantum, or a real-time task its runtime
+	if ((level == LEVEL_EDF && pp->rtUsed >= pp->rtRuntime)
+		|| (level == -1 && pp->usedQuantumTick >= TIME_QUANTUM_STRIDE)
+		|| (level >= 0 &&
+			pp->usedQuantumTick >= QuantumMLFQ(&mlfq, pp, level))
 			) {
 		
 		return 1;
@@ -1157,19 +1749,36 @@ checkquantum() {
 	}
 }
 
+// Whether lwp p, if it still is thread tid, is running on a cpu.
+// Reads without ptable.lock, so the answer may already be stale.
+int
+lwprunning(struct proc* p, int tid)
+{
+	struct Thread* t;
+
+	if (p == 0 || p->state != RUNNING) {
+		return 0;
+	}
+	t = p->thread;
+	return t != 0 && t->tid == tid;
+}
+
 // Get thread id
 int 
 gettid() {
-	struct procParse* pp = ppTable + (myproc() - ptable.proc);
-	return pp->threadNow->tid;
+	return myproc()->thread->tid;
 }
 
 // Round Robin LWP Scheduling
+// Give the cpu to the next RUNNABLE lwp of the same process
+// without going through the scheduler, or to the scheduler
+// if there is none. Lwps running on other cpus are left alone.
 void
 sched2() 
 {
-	struct proc* p = myproc(); // ptable' proc
-	struct procParse* pp = ppTable + (p - ptable.proc);
+	struct proc* p = myproc(); // lwp giving up the cpu
+	struct procParse* pp = ppTable + (p->group - ptable.proc);
+	struct proc* next;
 	int intena;
   
   	if(!holding(&ptable.lock))
@@ -1183,41 +1792,43 @@ sched2()
   	if(readeflags()&FL_IF)
     	panic("sched interruptible");
 
-	// Previous ptable's proc
-	struct proc* prev = swap(pp, RUNNABLE);
+	// p itself is found last, if it is still RUNNABLE.
+	// A turn lent to p is not passed on to its other lwps.
+	if (mycpu()->lender == 0) {
+		next = PickLWP(pp, p->thread, cpuid());
+	}
+	else {
+		next = p->state == RUNNABLE ? p : 0;
+	}
 
 	// If there are no RUNNABLE
-	if (prev == 0) {
-		// Before go to the scheduler,
-  		// Check who scheduled this process
-  		// If this process is scheduled by stride queue,
-  		// Push this process again to the stride queue with changed pass
-  		if (pp->level == -1) {
-      		PushStrideQueue(&strideQ, pp);
-  		}
-
+	if (next == 0) {
 		// Go to scheduler
 		sched();
 	}
-	// Else if ptable's proc is changed to new RUNNABLE
-	else if (p->context != prev->context) {
-		// Reset kernel stack's information
-  		mycpu()->ts.ss0 = SEG_KDATA << 3;
-  		mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
- 
-		p->state = RUNNING; // Swapped ptable's proc
+	// Else if another lwp is RUNNABLE, switch to it
+	else if (next != p) {
+		mycpu()->proc = next;
+		pp->threadNow = next->thread;
+		next->cpu = cpuid();
+
+		// Reset kernel stack and TLS segment information
+		switchlwp(next);
+		TraceSched(TRACE_LWP, next->pid, next->thread->tid, p->thread->tid, 0);
+		next->waittsc += rdtsc() - next->readytsc;
+		if (p->state == RUNNABLE) {
+			p->nivcsw++; // Preempted by yield2()
+		}
+
+		setstate(next, RUNNING);
 
 		intena = mycpu()->intena;
-		swtch(&(prev->context), p->context);
+		swtch(&(p->context), next->context);
 		mycpu()->intena = intena;
 	}
-	// no swapped, but stil RUNNABLE
+	// no other, but stil RUNNABLE
 	else {
-		if (p->state != RUNNABLE) {
-			panic("sched2 err: swap return no 0, But no RUNNABLE\n");
-		}
-
-		p->state = RUNNING; // ptable's proc is not changed
+		setstate(p, RUNNING);
 	}
 }
 
@@ -1225,7 +1836,8 @@ void
 yield2() 
 {
   acquire(&ptable.lock);
-  myproc()->state = RUNNABLE;
+  setstate(myproc(), RUNNABLE);
+  myproc()->readytsc = rdtsc();
   sched2();
   release(&ptable.lock);
 }
@@ -11,6 +11,9 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct procParse *lender;    // Process whose turn proc runs in, if not its own
+  volatile uint tlbreq;        // TLB flushes asked for by other cpus
+  volatile uint tlback;        // Of those, how many are done
 };
 
 extern struct cpu cpus[NCPU];
@@ -37,7 +40,9 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// Per-lwp state. A process's first lwp lives in its ptable slot,
+// the others in the process's thread directory. The slot also keeps
+// what the lwps share: sz, ofile, cwd and parent are only valid there.
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -52,12 +57,24 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint tlsbase;                // Base of this lwp's TLS page (%gs)
+  uint64 readytsc;             // rdtsc() when it last became RUNNABLE
+  uint64 waittsc;              // Cycles spent RUNNABLE, not running
+  uint ticks;                  // Timer ticks this lwp ran for
+  uint nvcsw;                  // Times it gave up the cpu itself
+  uint nivcsw;                 // Times it was preempted
+  uint lasttick;               // ticks when it was last charged a tick
+  uint cpumask;                // Cpus it may run on, bit i for cpu i
+  int cpu;                     // Cpu it runs or last ran on, -1 if none
+  struct sleeplock *waitlock;  // Sleeplock it sleeps on in acquiresleep()
+  struct proc *group;          // Process of this lwp (its ptable slot)
+  struct Thread *thread;       // Its entry in the thread directory
 };
 
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
-//   fixed-size stack
-//   expandable heap
+//   guard page, fixed-size stack, TLS page
+//   expandable heap (thread stacks are carved out of it the same way)
 
 #endif // PROC_H
@@ -5,27 +5,81 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
 #include "threadtypes.h"
 #include "addrstack.h"
+#include "execmap.h"
+
+struct LevelList;
+struct ShareGroup;
+struct StrideQueue;
 
 /* In the MLFQ and Stride scheduler, 
  * procParse structure is used for parsing proc structure */
 struct procParse{
 	struct proc* p;
-	int ticket;
-	double pass;
-	double stride;
+	int ticket; // Of the whole cpu, or of its share group
+	uint64 pass; // Fixed point, see STRIDE1
+	uint64 stride;
+	struct ShareGroup* shareGroup; // 0 if its tickets are of the whole cpu
+	struct StrideQueue* strideQueued; // Stride heap it is in, 0 if none
 	uint usedTick;
 	uint usedQuantumTick;
-	uint lastTick;
 	int level;
+	int nrunning; // Lwps on a cpu now
+	int nrunnable; // Lwps RUNNABLE now, kept by setstate()
+	int pinned; // Whether some lwp may not run on every cpu
+	int lastCpu; // Cpu an lwp of it was last picked on
+	uint lastTick; // ticks when an lwp of it last left a cpu
+
+	struct procParse* next; // Neighbours in the MLFQ level list
+	struct procParse* prev;
+	struct LevelList* list; // MLFQ level list it is in, 0 if none
+	uint epoch; // MLFQ boosts it has seen, see SyncMLFQ()
+
+	int nice; // -20 to 19, its weight in the CFS class
+	uint64 vruntime; // CFS virtual runtime, fixed point like pass
+	int inCFS; // In the CFS class, whether runnable or not
+	uint64 cfsKey; // vruntime it is sorted by in the CFS tree
+	int cfsWeight; // Weight it is counted with in the CFS tree
+	int cfsSlice; // Ticks it may run once picked
+	struct procParse* cfsLeft; // Children in the CFS tree
+	struct procParse* cfsRight;
+	int cfsHeight; // Of its subtree, 0 if not in the CFS tree
+
+	int rtRuntime; // Ticks it may run each period in the EDF class
+	int rtPeriod;
+	int rtDeadline; // Ticks into the period
+	uint rtRelease; // Tick the current period started
+	int rtUsed; // Ticks run in the current period
 
 	unsigned short tid; // New thread's id
-	struct Thread* threadNow; // Thread pointing ptable
+	struct Thread* threadNow; // Thread last picked, the next pick starts after it
+	int lwpShare; // Sum of the lwps' shares, 0 picks lwps round robin
+	int gang; // Whether its lwps are scheduled together, see set_gang()
+	uint64 lwpPass; // Pass of the lwp picked last
+	struct proc* stopper; // Lwp waiting for all others to exit, in exit or exec
 	struct ThreadPage* threadDir[NTHREADPAGE]; // Thread directory
 	struct AddrStack trashAddrStack; // To save exited thread's user stack
 
 	int execFlag; // If one of the thread doing exec, make flag true
+	struct ExecMap execMap; // Program file, pages are loaded on demand
+
+	// Serializes this process's lwps changing its address space
+	// (sz, thread stacks, trashAddrStack) and allocating or freeing
+	// thread slots. ptable.lock is only taken to change lwp states,
+	// and to free thread pages, which the scheduler walks.
+	struct sleeplock lock;
+
+	// Serializes its lwps' page faults and everything else that
+	// changes or copies the user part of its page table, see faultin().
+	// A spinlock, as faults also happen while other spinlocks are held.
+	struct spinlock pglock;
+
+	// Guards the slot's cwd, which lwps may change with chdir while
+	// others look paths up, see cwddup().
+	struct spinlock cwdlock;
 };
 
 #endif // PROCPARSE_H
@@ -0,0 +1,122 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "profile.h"
+
+// Kernel profiler.
+//
+// While profiling is on, every cpu records the pc it was
+// interrupted at on each timer interrupt, in its own buffer.
+// profLock keeps starting the profiler, which empties all buffers,
+// out of a sample being appended on another cpu. A full buffer
+// drops further samples.
+
+struct ProfBuf {
+	volatile uint n; // Samples recorded
+	struct ProfSample s[NPROFSAMPLE];
+};
+
+static struct ProfBuf profBuf[NCPU];
+static volatile int profOn;
+static struct spinlock profLock;
+
+void ProfileInit(void) {
+	initlock(&profLock, "profile");
+}
+
+// Called on every cpu's timer interrupt.
+void ProfileTick(struct trapframe* tf) {
+	struct ProfBuf* b;
+	struct ProfSample* s;
+	uint pcs[10];
+	int i;
+
+	if (!profOn) {
+		return;
+	}
+	acquire(&profLock);
+	b = &profBuf[cpuid()];
+	if (!profOn || b->n >= NPROFSAMPLE) {
+		release(&profLock);
+		return;
+	}
+
+	s = &(b->s[b->n]);
+	s->pc[0] = tf->eip;
+	for (i = 1; i < NPROFDEPTH; i++) {
+		s->pc[i] = 0;
+	}
+	// Walk the interrupted kernel code's frame pointers
+	if ((tf->cs & 3) == 0) {
+		getcallerpcs((uint*)tf->ebp + 2, pcs);
+		for (i = 1; i < NPROFDEPTH; i++) {
+			s->pc[i] = pcs[i - 1];
+		}
+	}
+
+	// Publish the sample after it is written
+	__sync_synchronize();
+	b->n++;
+	release(&profLock);
+}
+
+// int profctl(int on)
+// Start profiling with empty buffers, or stop it.
+int
+sys_profctl(void)
+{
+	int on, i;
+
+	if (argint(0, &on) < 0) {
+		return -1;
+	}
+
+	acquire(&profLock);
+	profOn = 0;
+	if (on) {
+		for (i = 0; i < ncpu; i++) {
+			profBuf[i].n = 0;
+		}
+		profOn = 1;
+	}
+	release(&profLock);
+	return 0;
+}
+
+// int profread(int cpu, struct ProfSample* buf, int n)
+// Copy the first n or fewer samples of cpu into buf.
+// Returns the number of samples, or -1 if there is no such cpu.
+int
+sys_profread(void)
+{
+	int cpu, n;
+	uint m;
+	struct ProfSample* buf;
+
+	if (argint(0, &cpu) < 0 || argint(2, &n) < 0) {
+		return -1;
+	}
+	if (n < 0 || n > NPROFSAMPLE) {
+		return -1;
+	}
+	if (argptr(1, (char**)&buf, n * sizeof(struct ProfSample)) < 0) {
+		return -1;
+	}
+	if (cpu < 0 || cpu >= ncpu) {
+		return -1;
+	}
+
+	// Samples below n are complete and never change
+	m = profBuf[cpu].n;
+	__sync_synchronize();
+	if (n > m) {
+		n = m;
+	}
+	memmove(buf, profBuf[cpu].s, n * sizeof(struct ProfSample));
+	return n;
+}
@@ -0,0 +1,14 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define NPROFSAMPLE (512) // Samples kept per cpu
+#define NPROFDEPTH  (4)   // Pcs kept per sample
+
+// One timer interrupt. pc[0] is the interrupted eip, below
+// KERNBASE if it was in user space. For kernel samples, the
+// return addresses of its callers follow, 0 where the stack ended.
+struct ProfSample {
+	uint pc[NPROFDEPTH];
+};
+
+#endif // PROFILE_H
@@ -0,0 +1,23 @@
+#ifndef PSTAT_H
+#define PSTAT_H
+
+// Accounting of one lwp, as returned by getpstat().
+// Process-wide fields are repeated in every lwp of the process.
+struct PStat {
+	int pid;
+	int ppid;
+	ushort tid;
+	uchar state; // enum procstate of the lwp
+	char cpu; // Cpu it runs or last ran on, -1 if none yet
+	char level; // MLFQ level, -1 under the stride scheduler, -2 real-time
+	char name[16];
+	int ticket; // Tickets held under the stride scheduler or real-time
+	uint pass; // Integer part of the stride pass
+	uint usedTick; // Ticks used at the current MLFQ level
+	uint ticks; // Timer ticks the lwp ran for
+	uint nvcsw; // Voluntary context switches
+	uint nivcsw; // Involuntary context switches
+	uint64 waittsc; // Cycles spent RUNNABLE, waiting for a cpu
+};
+
+#endif // PSTAT_H
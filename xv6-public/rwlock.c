@@ -0,0 +1,100 @@
+// Reader-writer spin locks, for state that is read much
+// more often than it is changed. Like spinlocks, they are
+// held with interrupts off and must not be held across sleep.
+// A reader must not acquire the same lock again, since a
+// writer may be waiting between the two.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+  lk->name = name;
+  lk->state = 0;
+  lk->cpu = 0;
+}
+
+void
+acquireread(struct rwlock *lk)
+{
+  uint s;
+
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquireread");
+
+  for(;;){
+    s = lk->state;
+    if(!(s & RW_WRITER) && cmpxchg(&lk->state, s, s + 1) == s)
+      break;
+    pause();
+  }
+  __sync_synchronize();
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+  if((lk->state & ~RW_WRITER) == 0)
+    panic("releaseread");
+
+  __sync_synchronize();
+  xadd(&lk->state, -1);
+  popcli();
+}
+
+void
+acquirewrite(struct rwlock *lk)
+{
+  uint s;
+
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+
+  // Claim the writer bit, which stops new readers,
+  // then wait for the readers inside to leave.
+  for(;;){
+    s = lk->state;
+    if(!(s & RW_WRITER) && cmpxchg(&lk->state, s, s | RW_WRITER) == s)
+      break;
+    pause();
+  }
+  while(lk->state != RW_WRITER)
+    pause();
+  __sync_synchronize();
+
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+
+  lk->cpu = 0;
+  __sync_synchronize();
+
+  // No reader can have come in, so nothing else changes state.
+  asm volatile("movl $0, %0" : "+m" (lk->state) : );
+  popcli();
+}
+
+int
+holdingwrite(struct rwlock *lk)
+{
+  int r;
+
+  pushcli();
+  r = lk->state == RW_WRITER && lk->cpu == mycpu();
+  popcli();
+  return r;
+}
@@ -0,0 +1,16 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#define RW_WRITER 0x80000000 // state bit: a writer holds or waits for it
+
+// Reader-writer spin lock. Any number of readers,
+// or one writer. A waiting writer keeps new readers out.
+struct rwlock {
+  volatile uint state; // RW_WRITER | number of readers
+
+  // For debugging:
+  char *name;          // Name of lock.
+  struct cpu *cpu;     // The cpu holding it for writing.
+};
+
+#endif // RWLOCK_H
@@ -0,0 +1,111 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedtrace.h"
+
+// Print the scheduler trace of every cpu.
+//
+// usage: schedstat [-v]
+//   Without -v, print per cpu how often each event happened,
+//   how picks spread over the MLFQ levels and the stride scheduler,
+//   and how long picked lwps had been waiting to run.
+//   With -v, also print the events themselves, oldest first.
+
+char *typename[NTRACETYPE] = {
+  [TRACE_PICK]    "pick",
+  [TRACE_PREEMPT] "preempt",
+  [TRACE_DEMOTE]  "demote",
+  [TRACE_BOOST]   "boost",
+  [TRACE_LWP]     "lwp",
+  [TRACE_SLEEP]   "sleep",
+  [TRACE_WAKEUP]  "wakeup",
+  [TRACE_LEND]    "lend",
+};
+
+struct SchedEvent ev[NSCHEDTRACE];
+
+// Cycle counts are printed in units of 1024 cycles,
+// which keeps the arithmetic in 32 bits.
+#define KCYCLE(c) ((uint)((c) >> 10))
+
+static void
+dump(int n)
+{
+  int i;
+  uint64 base;
+
+  base = ev[0].tsc;
+  for(i = 0; i < n; i++){
+    printf(1, "  %d +%dk %s pid %d tid %d",
+           ev[i].seq, KCYCLE(ev[i].tsc - base), typename[ev[i].type],
+           ev[i].pid, ev[i].tid);
+    switch(ev[i].type){
+    case TRACE_PICK:
+      printf(1, " level %d waited %dk", ev[i].arg, KCYCLE(ev[i].arg2));
+      break;
+    case TRACE_PREEMPT:
+    case TRACE_DEMOTE:
+      printf(1, " level %d", ev[i].arg);
+      break;
+    case TRACE_LWP:
+      printf(1, " from tid %d", ev[i].arg);
+      break;
+    }
+    printf(1, "\n");
+  }
+}
+
+static void
+summary(int n)
+{
+  int count[NTRACETYPE];
+  int picks[4];  // stride, level 0, 1, 2
+  uint waitsum, waitmax, w;
+  int i, t;
+
+  memset(count, 0, sizeof(count));
+  memset(picks, 0, sizeof(picks));
+  waitsum = waitmax = 0;
+
+  for(i = 0; i < n; i++){
+    t = ev[i].type;
+    if(t <= 0 || t >= NTRACETYPE)
+      continue;
+    count[t]++;
+    if(t != TRACE_PICK)
+      continue;
+    if(ev[i].arg >= -1 && ev[i].arg <= 2)
+      picks[ev[i].arg + 1]++;
+    w = KCYCLE(ev[i].arg2);
+    waitsum += w;
+    if(w > waitmax)
+      waitmax = w;
+  }
+
+  for(t = 1; t < NTRACETYPE; t++)
+    printf(1, "  %s %d", typename[t], count[t]);
+  printf(1, "\n  picks: stride %d, L0 %d, L1 %d, L2 %d\n",
+         picks[0], picks[1], picks[2], picks[3]);
+  if(count[TRACE_PICK] > 0)
+    printf(1, "  wait: avg %dk max %dk cycles\n",
+           waitsum / count[TRACE_PICK], waitmax);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int cpu, n, verbose;
+
+  verbose = argc >= 2 && strcmp(argv[1], "-v") == 0;
+
+  for(cpu = 0; (n = schedtrace(cpu, ev, NSCHEDTRACE)) >= 0; cpu++){
+    printf(1, "cpu %d: %d events\n", cpu, n);
+    if(n == 0)
+      continue;
+    if(verbose)
+      dump(n);
+    summary(n);
+  }
+  exit();
+}
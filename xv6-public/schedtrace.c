@@ -0,0 +1,106 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "schedtrace.h"
+
+// Scheduler trace.
+//
+// Every cpu records its scheduling events in its own ring, so
+// recording takes no lock: interrupts are off while a cpu writes
+// its ring, and only that cpu writes it.
+// A reader copies a ring without stopping the writer, then drops
+// the events that were overwritten while it was copying.
+
+struct TraceRing {
+	volatile uint head; // Events ever written, the next is at head % NSCHEDTRACE
+	struct SchedEvent ev[NSCHEDTRACE];
+};
+
+static struct TraceRing traceRing[NCPU];
+
+void TraceSched(int type, int pid, int tid, int arg, uint arg2) {
+	struct TraceRing* r;
+	struct SchedEvent* e;
+	uint head;
+
+	pushcli();
+	r = &traceRing[cpuid()];
+	head = r->head;
+
+	e = &(r->ev[head % NSCHEDTRACE]);
+	e->tsc = rdtsc();
+	e->seq = head;
+	e->type = type;
+	e->cpu = cpuid();
+	e->tid = tid;
+	e->pid = pid;
+	e->arg = arg;
+	e->arg2 = arg2;
+
+	// Publish the event after it is written
+	__sync_synchronize();
+	r->head = head + 1;
+	popcli();
+}
+
+// Copy the last n or fewer events of the cpu to dst, oldest first.
+// Returns the number of events copied.
+static int ReadTraceRing(int cpu, struct SchedEvent* dst, int n) {
+	struct TraceRing* r = &traceRing[cpu];
+	uint head, first, tail;
+	int i, m;
+
+	head = r->head;
+	__sync_synchronize();
+
+	m = head < NSCHEDTRACE ? head : NSCHEDTRACE;
+	if (n > m) {
+		n = m;
+	}
+	first = head - n;
+	for (i = 0; i < n; i++) {
+		dst[i] = r->ev[(first + i) % NSCHEDTRACE];
+	}
+
+	// The writer may have lapped us. Keep the events that were
+	// not overwritten during the copy, nor are being overwritten.
+	__sync_synchronize();
+	tail = r->head;
+	if (tail + 1 - first > NSCHEDTRACE) {
+		m = tail + 1 - first - NSCHEDTRACE;
+		if (m >= n) {
+			return 0;
+		}
+		memmove(dst, dst + m, (n - m) * sizeof(struct SchedEvent));
+		n -= m;
+	}
+	return n;
+}
+
+// int schedtrace(int cpu, struct SchedEvent* buf, int n)
+// Copy the last n or fewer events recorded by cpu into buf.
+// Returns the number of events, or -1 if there is no such cpu.
+int
+sys_schedtrace(void)
+{
+	int cpu, n;
+	struct SchedEvent* buf;
+
+	if (argint(0, &cpu) < 0 || argint(2, &n) < 0) {
+		return -1;
+	}
+	if (n < 0 || n > NSCHEDTRACE) {
+		return -1;
+	}
+	if (argout(1, (char**)&buf, n * sizeof(struct SchedEvent)) < 0) {
+		return -1;
+	}
+	if (cpu < 0 || cpu >= ncpu) {
+		return -1;
+	}
+
+	return ReadTraceRing(cpu, buf, n);
+}
@@ -0,0 +1,30 @@
+#ifndef SCHEDTRACE_H
+#define SCHEDTRACE_H
+
+#define NSCHEDTRACE (256) // Events kept per cpu
+
+// Scheduler trace event types
+#define TRACE_PICK    1 // scheduler() picked pid. arg: level, arg2: cycles waited
+#define TRACE_PREEMPT 2 // Time quantum used up. arg: level
+#define TRACE_DEMOTE  3 // Time allotment used up. arg: new level
+#define TRACE_BOOST   4 // MLFQ priority boost
+#define TRACE_LWP     5 // sched2() switched lwps. arg: previous tid
+#define TRACE_SLEEP   6 // lwp went to sleep
+#define TRACE_WAKEUP  7 // lwp woken up
+#define TRACE_LEND    8 // Sleeplock holder picked in a waiter's turn. arg: waiter pid
+#define NTRACETYPE    9
+
+// Level in arg of TRACE_PICK and TRACE_PREEMPT
+// is -1 for the stride scheduler.
+struct SchedEvent {
+	uint64 tsc; // rdtsc() at the event
+	uint seq; // Event number on its cpu
+	uchar type;
+	uchar cpu;
+	ushort tid;
+	int pid;
+	int arg;
+	uint arg2;
+};
+
+#endif // SCHEDTRACE_H
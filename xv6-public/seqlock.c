@@ -0,0 +1,58 @@
+// Sequence locks, for small read-mostly data that readers can
+// copy and check: readers never delay writers or each other.
+//
+//   do {
+//     seq = readseqbegin(&sl);
+//     ... copy the data ...
+//   } while(readseqretry(&sl, seq));
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "seqlock.h"
+
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lk, name);
+  sl->seq = 0;
+}
+
+void
+acquireseq(struct seqlock *sl)
+{
+  acquire(&sl->lk);
+  sl->seq++;
+  __sync_synchronize();
+}
+
+void
+releaseseq(struct seqlock *sl)
+{
+  __sync_synchronize();
+  sl->seq++;
+  release(&sl->lk);
+}
+
+// Sequence number to hand to readseqretry().
+// Waits while a writer is inside.
+uint
+readseqbegin(struct seqlock *sl)
+{
+  uint seq;
+
+  while((seq = sl->seq) & 1)
+    pause();
+  __sync_synchronize();
+  return seq;
+}
+
+// Whether the data read since readseqbegin() may be torn.
+int
+readseqretry(struct seqlock *sl, uint seq)
+{
+  __sync_synchronize();
+  return sl->seq != seq;
+}
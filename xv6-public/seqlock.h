@@ -0,0 +1,15 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "spinlock.h"
+
+// Sequence lock. Writers serialize on lk and make seq odd while
+// they change the data. Readers take no lock: they read seq,
+// copy the data, and retry if seq was odd or has moved.
+// lk can also be passed to sleep() by code waiting for a change.
+struct seqlock {
+  volatile uint seq;
+  struct spinlock lk;
+};
+
+#endif // SEQLOCK_H
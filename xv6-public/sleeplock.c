@@ -10,6 +10,10 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+// Longest spin on a sleep lock before sleeping, in cycles.
+// Sleeping and being woken costs two context switches.
+#define SLEEPSPIN 50000
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
@@ -17,17 +21,46 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+  lk->tid = 0;
+}
+
+// Spin while the holder is running on another cpu, since it is
+// likely to release the lock soon. Gives up after SLEEPSPIN cycles,
+// or once the holder stops running. Returns with lk->lk held.
+static void
+spinsleep(struct sleeplock *lk, uint64 *deadline)
+{
+  if(*deadline == 0)
+    *deadline = rdtsc() + SLEEPSPIN;
+
+  release(&lk->lk);
+  while(lk->locked && lwprunning(lk->owner, lk->tid) && rdtsc() < *deadline)
+    pause();
+  acquire(&lk->lk);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint64 deadline = 0;
+
   acquire(&lk->lk);
   while (lk->locked) {
-    sleep(lk, &lk->lk);
+    if(lwprunning(lk->owner, lk->tid) &&
+       (deadline == 0 || rdtsc() < deadline))
+      spinsleep(lk, &deadline);
+    else {
+      // Lets the holder run in our turn, see LentLWP()
+      myproc()->waitlock = lk;
+      sleep(lk, &lk->lk);
+      myproc()->waitlock = 0;
+    }
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+  lk->tid = gettid();
   release(&lk->lk);
 }
 
@@ -37,6 +70,7 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
@@ -47,7 +81,7 @@ holdingsleep(struct sleeplock *lk)
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  r = lk->locked && (lk->owner == myproc());
   release(&lk->lk);
   return r;
 }
@@ -1,3 +1,6 @@
+#ifndef SLEEPLOCK_H
+#define SLEEPLOCK_H
+
 // Long-term locks for processes
 struct sleeplock {
   uint locked;       // Is the lock held?
@@ -6,5 +9,10 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For spinning while the holder runs:
+  struct proc *owner; // ptable slot of the holder
+  int tid;            // Holder's lwp
 };
 
+#endif // SLEEPLOCK_H
@@ -8,13 +8,33 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+#ifdef TICKETLOCK
+  lk->next = 0;
+  lk->owner = 0;
+#endif
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = RegisterLock(name);
+#else
+  lk->stat = 0; // acquire and release skip the statistics
+#endif
+}
+
+// The memory of lk is about to be freed, lk is gone from the
+// statistics. Locks in memory that is never freed don't call it.
+void
+droplock(struct spinlock *lk)
+{
+  if(lk->stat)
+    DropLock(lk->stat);
+  lk->stat = 0;
 }
 
 // Acquire the lock.
@@ -24,13 +44,41 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spin;
+  int contended;
+#ifdef TICKETLOCK
+  uint ticket;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+  // Only time the spin if the lock was held on the first try.
+  contended = 0;
+#ifdef TICKETLOCK
+  // Take a ticket, then wait until it is served. Waiters only read
+  // owner, so they spin in their own caches until the holder's
+  // release writes it, and they get the lock in arrival order.
+  ticket = xadd(&lk->next, 1);
+  if(lk->owner != ticket){
+    contended = 1;
+    spin = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+    spin = rdtsc() - spin;
+  }
+  lk->locked = 1;
+#else
   // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  if(xchg(&lk->locked, 1) != 0){
+    contended = 1;
+    spin = rdtsc();
+    while(xchg(&lk->locked, 1) != 0)
+      pause();
+    spin = rdtsc() - spin;
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +88,15 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->stat){
+    lk->stat->nacquire++;
+    if(contended){
+      lk->stat->ncontend++;
+      lk->stat->spintsc += spin;
+    }
+    lk->acqtsc = rdtsc();
+  }
 }
 
 // Release the lock.
@@ -51,6 +108,8 @@ release(struct spinlock *lk)
     panic("release");
 
   //cprintf("releerssfw1231\n");
+  if(lk->stat)
+    HoldLock(lk->stat, rdtsc() - lk->acqtsc);
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -65,6 +124,10 @@ release(struct spinlock *lk)
   // This code can't use a C assignment, since it might
   // not be atomic. A real OS would use C atomics here.
   asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+#ifdef TICKETLOCK
+  // Serve the next ticket. Only the holder writes owner.
+  asm volatile("movl %1, %0" : "+m" (lk->owner) : "r" (lk->owner + 1));
+#endif
   //cprintf("end\n");
   popcli();
 }
@@ -2,14 +2,25 @@
 #define SPINLOCK_H
 
 // Mutual exclusion lock.
+// Built as a ticket lock with -DTICKETLOCK (make SPINLOCK=ticket),
+// as a test-and-set lock otherwise. Statistics are only kept
+// with -DLOCKSTAT (make LOCKSTAT=on).
 struct spinlock {
   uint locked;       // Is the lock held?
+#ifdef TICKETLOCK
+  volatile uint next;  // Next ticket to hand out
+  volatile uint owner; // Ticket allowed to hold the lock
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For contention statistics:
+  struct LockStat *stat; // Entry of this lock's name, 0 without LOCKSTAT
+  uint64 acqtsc;     // rdtsc() when the lock was acquired
 };
 
 #endif // SPINLOCK_H
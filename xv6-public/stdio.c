@@ -0,0 +1,501 @@
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "user.h"
+#include "x86.h"
+
+// Buffered I/O.
+//
+// A FILE collects the bytes written to it and hands them to the
+// kernel with one write() when its buffer fills up, or, if it is
+// line buffered, at the end of each line. Reads are done BUFSIZ
+// bytes at a time the same way.
+//
+// stdout is line buffered and stderr unbuffered. There is no exit
+// hook, so a program must fflush() or fclose() fully buffered
+// streams, and stdout if its last line has no newline, before exit().
+//
+// printf() formats into a buffer on the stack and writes it with a
+// single write(), so unlike the FILEs it never holds output back.
+
+#define NSTDFILE  16      // streams open at once
+#define NSPIN     100     // tries before flockfile() yields
+
+#define F_READ    0x1
+#define F_WRITE   0x2
+
+struct stdfile {
+  int used;             // slot is taken
+  int fd;
+  int flags;            // F_READ, F_WRITE
+  int mode;             // _IOFBF, _IOLBF or _IONBF
+  volatile uint locked; // held while the stream is used
+  char *buf;
+  int size;             // size of buf
+  int wlen;             // bytes in buf waiting for write()
+  int rpos, rlen;       // unread bytes are buf[rpos..rlen)
+  int err;
+  int eof;
+};
+
+static char stdbuf[NSTDFILE][BUFSIZ];
+
+static FILE files[NSTDFILE] = {
+  { 1, 0, F_READ, _IOLBF },
+  { 1, 1, F_WRITE, _IOLBF },
+  { 1, 2, F_WRITE, _IONBF },
+};
+
+FILE *stdin = &files[0];
+FILE *stdout = &files[1];
+FILE *stderr = &files[2];
+
+// A stream may stay locked across a write system call that
+// sleeps, so only spin briefly before letting another thread run.
+void
+flockfile(FILE *f)
+{
+  int i;
+
+  for(i = 0; xchg(&f->locked, 1) != 0; i++){
+    if(i < NSPIN)
+      pause();
+    else {
+      yield();
+      i = 0;
+    }
+  }
+}
+
+void
+funlockfile(FILE *f)
+{
+  xchg(&f->locked, 0);
+}
+
+static void
+setup(FILE *f)
+{
+  if(f->buf == 0){
+    f->buf = stdbuf[f - files];
+    f->size = BUFSIZ;
+  }
+}
+
+// Write out the buffered bytes. Caller holds the lock.
+static int
+flush(FILE *f)
+{
+  int n, off;
+
+  for(off = 0; off < f->wlen; off += n){
+    if((n = write(f->fd, f->buf + off, f->wlen - off)) <= 0){
+      f->err = 1;
+      f->wlen = 0;
+      return EOF;
+    }
+  }
+  f->wlen = 0;
+  return 0;
+}
+
+// Buffer n bytes for writing. Caller holds the lock.
+static int
+put(FILE *f, const char *p, int n)
+{
+  int i, m, nl;
+
+  if((f->flags & F_WRITE) == 0){
+    f->err = 1;
+    return EOF;
+  }
+  setup(f);
+  f->rpos = f->rlen = 0;  // drop read-ahead, xv6 can't seek back
+
+  // Too big to be worth copying.
+  if(f->mode == _IONBF || (f->wlen == 0 && n >= f->size)){
+    if(flush(f) < 0 || write(f->fd, p, n) != n){
+      f->err = 1;
+      return EOF;
+    }
+    return 0;
+  }
+
+  nl = 0;
+  while(n > 0){
+    if(f->wlen == f->size && flush(f) < 0)
+      return EOF;
+    m = f->size - f->wlen;
+    if(m > n)
+      m = n;
+    memmove(f->buf + f->wlen, p, m);
+    if(f->mode == _IOLBF)
+      for(i = 0; i < m && !nl; i++)
+        nl = p[i] == '\n';
+    f->wlen += m;
+    p += m;
+    n -= m;
+  }
+  if(nl)
+    return flush(f);
+  return 0;
+}
+
+// Refill the read buffer. Caller holds the lock.
+static int
+fill(FILE *f)
+{
+  int n;
+
+  if((f->flags & F_READ) == 0){
+    f->err = 1;
+    return EOF;
+  }
+  setup(f);
+  if(f->wlen > 0 && flush(f) < 0)
+    return EOF;
+  // Reading a line buffered stream flushes stdout, like a prompt.
+  if(f->mode == _IOLBF && f != stdout && stdout->wlen > 0){
+    flockfile(stdout);
+    flush(stdout);
+    funlockfile(stdout);
+  }
+
+  n = read(f->fd, f->buf, f->mode == _IONBF ? 1 : f->size);
+  if(n <= 0){
+    if(n < 0)
+      f->err = 1;
+    else
+      f->eof = 1;
+    return EOF;
+  }
+  f->rpos = 0;
+  f->rlen = n;
+  return 0;
+}
+
+static FILE*
+alloc(int fd, int flags)
+{
+  FILE *f;
+
+  for(f = files; f < files + NSTDFILE; f++){
+    if(xchg((uint*)&f->used, 1) == 0){
+      f->fd = fd;
+      f->flags = flags;
+      f->mode = _IOFBF;
+      f->buf = 0;
+      f->wlen = f->rpos = f->rlen = 0;
+      f->err = f->eof = 0;
+      return f;
+    }
+  }
+  return 0;
+}
+
+// Translate an fopen() mode. xv6 can't truncate or append,
+// so "w" overwrites the start of an existing file.
+static int
+parsemode(const char *mode, int *omode)
+{
+  int flags;
+
+  if(mode[0] == 'r'){
+    flags = F_READ;
+    *omode = O_RDONLY;
+  } else if(mode[0] == 'w'){
+    flags = F_WRITE;
+    *omode = O_WRONLY | O_CREATE;
+  } else
+    return -1;
+  if(strchr(mode, '+')){
+    flags = F_READ | F_WRITE;
+    *omode = (*omode & O_CREATE) | O_RDWR;
+  }
+  return flags;
+}
+
+FILE*
+fopen(const char *path, const char *mode)
+{
+  FILE *f;
+  int fd, flags, omode;
+
+  if((flags = parsemode(mode, &omode)) < 0)
+    return 0;
+  if((fd = open(path, omode)) < 0)
+    return 0;
+  if((f = alloc(fd, flags)) == 0){
+    close(fd);
+    return 0;
+  }
+  return f;
+}
+
+FILE*
+fdopen(int fd, const char *mode)
+{
+  int flags, omode;
+
+  if((flags = parsemode(mode, &omode)) < 0)
+    return 0;
+  return alloc(fd, flags);
+}
+
+int
+fclose(FILE *f)
+{
+  int r;
+
+  flockfile(f);
+  r = flush(f);
+  if(close(f->fd) < 0)
+    r = EOF;
+  funlockfile(f);
+  xchg((uint*)&f->used, 0);
+  return r;
+}
+
+// Flush f, or every stream if f is 0.
+int
+fflush(FILE *f)
+{
+  int r;
+
+  if(f == 0){
+    r = 0;
+    for(f = files; f < files + NSTDFILE; f++)
+      if(f->used && f->wlen > 0 && fflush(f) < 0)
+        r = EOF;
+    return r;
+  }
+  flockfile(f);
+  r = flush(f);
+  funlockfile(f);
+  return r;
+}
+
+// Use buf of size bytes (or the stream's own if buf is 0) and
+// the given buffering mode. Must be called before any I/O on f.
+int
+setvbuf(FILE *f, char *buf, int mode, int size)
+{
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+  if(buf != 0 && size <= 0)
+    return -1;
+  flockfile(f);
+  f->mode = mode;
+  if(buf != 0){
+    f->buf = buf;
+    f->size = size;
+  }
+  funlockfile(f);
+  return 0;
+}
+
+int
+fileno(FILE *f)
+{
+  return f->fd;
+}
+
+int
+ferror(FILE *f)
+{
+  return f->err;
+}
+
+int
+feof(FILE *f)
+{
+  return f->eof;
+}
+
+// Return the number of whole items written.
+int
+fwrite(const void *p, int size, int n, FILE *f)
+{
+  if(size <= 0 || n <= 0)
+    return 0;
+  flockfile(f);
+  if(put(f, p, size * n) < 0)
+    n = 0;
+  funlockfile(f);
+  return n;
+}
+
+// Return the number of whole items read.
+int
+fread(void *p, int size, int n, FILE *f)
+{
+  char *dst = p;
+  int want, got, m;
+
+  if(size <= 0 || n <= 0)
+    return 0;
+  want = size * n;
+  flockfile(f);
+  for(got = 0; got < want; got += m){
+    if(f->rpos == f->rlen && fill(f) < 0)
+      break;
+    m = f->rlen - f->rpos;
+    if(m > want - got)
+      m = want - got;
+    memmove(dst + got, f->buf + f->rpos, m);
+    f->rpos += m;
+  }
+  funlockfile(f);
+  return got / size;
+}
+
+int
+putc_unlocked(int c, FILE *f)
+{
+  char ch = c;
+
+  // Fast path: room in the buffer and no line end.
+  if(f->buf != 0 && f->mode == _IOFBF && f->wlen < f->size &&
+     f->rlen == 0 && (f->flags & F_WRITE)){
+    f->buf[f->wlen++] = ch;
+    return ch & 0xff;
+  }
+  if(put(f, &ch, 1) < 0)
+    return EOF;
+  return ch & 0xff;
+}
+
+int
+fputc(int c, FILE *f)
+{
+  flockfile(f);
+  c = putc_unlocked(c, f);
+  funlockfile(f);
+  return c;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  int r;
+
+  flockfile(f);
+  r = put(f, s, strlen(s));
+  funlockfile(f);
+  return r;
+}
+
+int
+fgetc(FILE *f)
+{
+  int c;
+
+  flockfile(f);
+  if(f->rpos == f->rlen && fill(f) < 0)
+    c = EOF;
+  else
+    c = f->buf[f->rpos++] & 0xff;
+  funlockfile(f);
+  return c;
+}
+
+static void
+printint(FILE *f, int xx, int base, int sgn)
+{
+  static char digits[] = "0123456789ABCDEF";
+  char buf[16];
+  int i, neg;
+  uint x;
+
+  neg = 0;
+  if(sgn && xx < 0){
+    neg = 1;
+    x = -xx;
+  } else {
+    x = xx;
+  }
+
+  i = 0;
+  do{
+    buf[i++] = digits[x % base];
+  }while((x /= base) != 0);
+  if(neg)
+    buf[i++] = '-';
+
+  while(--i >= 0)
+    putc_unlocked(buf[i], f);
+}
+
+// Format to f. Only understands %d, %x, %p, %s, %c.
+// Caller holds f's lock.
+static void
+vfprintf(FILE *f, const char *fmt, uint *ap)
+{
+  char *s;
+  int c, i, state;
+
+  state = 0;
+  for(i = 0; fmt[i]; i++){
+    c = fmt[i] & 0xff;
+    if(state == 0){
+      if(c == '%'){
+        state = '%';
+      } else {
+        putc_unlocked(c, f);
+      }
+    } else if(state == '%'){
+      if(c == 'd'){
+        printint(f, *ap, 10, 1);
+        ap++;
+      } else if(c == 'x' || c == 'p'){
+        printint(f, *ap, 16, 0);
+        ap++;
+      } else if(c == 's'){
+        s = (char*)*ap;
+        ap++;
+        if(s == 0)
+          s = "(null)";
+        while(*s != 0){
+          putc_unlocked(*s, f);
+          s++;
+        }
+      } else if(c == 'c'){
+        putc_unlocked(*ap, f);
+        ap++;
+      } else if(c == '%'){
+        putc_unlocked(c, f);
+      } else {
+        // Unknown % sequence.  Print it to draw attention.
+        putc_unlocked('%', f);
+        putc_unlocked(c, f);
+      }
+      state = 0;
+    }
+  }
+}
+
+void
+fprintf(FILE *f, const char *fmt, ...)
+{
+  flockfile(f);
+  vfprintf(f, fmt, (uint*)(void*)&fmt + 1);
+  funlockfile(f);
+}
+
+// Print to the given fd. Only understands %d, %x, %p, %s, %c.
+// The whole message goes out with one write() per BUFSIZ bytes.
+void
+printf(int fd, const char *fmt, ...)
+{
+  FILE f;
+  char buf[BUFSIZ];
+
+  memset(&f, 0, sizeof(f));
+  f.fd = fd;
+  f.flags = F_WRITE;
+  f.mode = _IOFBF;
+  f.buf = buf;
+  f.size = sizeof(buf);
+  vfprintf(&f, fmt, (uint*)(void*)&fmt + 1);
+  flush(&f);
+}
@@ -1,9 +1,12 @@
 #include "stridequeue.h"
 #include "defs.h"
 #include "ticketbox.h"
+#include "thread.h"
 
 extern struct TicketBox ticketbox;// Total global tickets(remained tickets)
-extern double CONST_FOR_STRIDE; // Used in making stride
+extern struct StrideQueue strideQ; // Processes holding tickets of the whole cpu
+
+struct ShareGroup shareGroups[NSHAREGROUP];
 
 /* Stride scheduler has time quantum
  * Declare this limit to the constants */
@@ -20,6 +23,12 @@ void PushStrideQueue(struct StrideQueue* strideQ, struct procParse* pp){
 		return;
 	}
 
+	/* A process is in one heap at most */
+	if (pp->strideQueued != 0) {
+		return;
+	}
+	pp->strideQueued = strideQ;
+
 	/* Use min heap algorithm, Sort procParse */
 	int i = ++(strideQ->size); // Start from the last
 	strideQ->minPassHeap[i] = pp;
@@ -31,8 +40,8 @@ void PushStrideQueue(struct StrideQueue* strideQ, struct procParse* pp){
 		
 		/* If child has lower pass than parent,
 		 * change each other. */
-		if (strideQ->minPassHeap[i]->pass
-				< strideQ->minPassHeap[parentIndex]->pass) {
+		if (PASSBEFORE(strideQ->minPassHeap[i]->pass,
+				strideQ->minPassHeap[parentIndex]->pass)) {
 			tmp = strideQ->minPassHeap[parentIndex];
 
 			strideQ->minPassHeap[parentIndex] = strideQ->minPassHeap[i];
@@ -55,6 +64,8 @@ void PopStrideQueue(struct StrideQueue* strideQ){
 		return;
 	}
 
+	strideQ->minPassHeap[1]->strideQueued = 0;
+
 	/* Use min heap algorithm */
 	strideQ->minPassHeap[1] = strideQ->minPassHeap[strideQ->size];
 	strideQ->size--; // Move last to the first.
@@ -65,8 +76,8 @@ void PopStrideQueue(struct StrideQueue* strideQ){
 	while (i * 2 + 1 <= strideQ->size) { // Parent has right child.
 		/* Compare right child and left child.
 		 * Then choose child who has lower pass. */
-		if (strideQ->minPassHeap[i * 2]->pass
-				> strideQ->minPassHeap[i * 2 + 1]->pass){
+		if (PASSBEFORE(strideQ->minPassHeap[i * 2 + 1]->pass,
+				strideQ->minPassHeap[i * 2]->pass)){
 			childIndex = i * 2 + 1;
 		}
 		else {
@@ -74,8 +85,8 @@ void PopStrideQueue(struct StrideQueue* strideQ){
 		}
 
 		/* Compare child and parent. */
-		if (strideQ->minPassHeap[i]->pass
-				> strideQ->minPassHeap[childIndex]->pass) {
+		if (PASSBEFORE(strideQ->minPassHeap[childIndex]->pass,
+				strideQ->minPassHeap[i]->pass)) {
 			/* If child has lower pass,
 			 * Change parent and child each other. */
 			tmp = strideQ->minPassHeap[i];
@@ -96,7 +107,8 @@ void PopStrideQueue(struct StrideQueue* strideQ){
 	 * this case is not managed by while loop.
 	 * So, check it. */
 	if (i * 2 == strideQ->size && 
-		strideQ->minPassHeap[i]->pass > strideQ->minPassHeap[i * 2]->pass){
+		PASSBEFORE(strideQ->minPassHeap[i * 2]->pass,
+				   strideQ->minPassHeap[i]->pass)){
 		tmp = strideQ->minPassHeap[i];
 
 		strideQ->minPassHeap[i] = strideQ->minPassHeap[i * 2];
@@ -121,7 +133,7 @@ struct procParse* GetTopStrideQueue(struct StrideQueue* strideQ){
 int InsertStrideQueue(struct StrideQueue* strideQ,
 						  struct procParse* pp,
 						  int ticket,
-						  double minPass){
+						  uint64 minPass){
 
 	acquire(&ticketbox.lock);
 
@@ -170,7 +182,7 @@ int InsertStrideQueue(struct StrideQueue* strideQ,
 
 	release(&ticketbox.lock);
 
-	pp->stride = CONST_FOR_STRIDE / pp->ticket;
+	pp->stride = STRIDE1 / pp->ticket;
 	pp->level = -1;
 
 	// pp's pass is changed only if
@@ -181,7 +193,28 @@ int InsertStrideQueue(struct StrideQueue* strideQ,
 	return 0;
 }
 
-struct procParse* SearchStrideQueue(struct StrideQueue* strideQ){
+/* Whether top, just popped from strideQ, is not to be scheduled from
+ * there. It left the stride scheduler or moved to another queue, or
+ * it is dead. Put it where it belongs, or give its tickets back. */
+static int StaleStrideQueue(struct StrideQueue* strideQ, struct procParse* top){
+	/* Not under the stride scheduler, or not in this heap any more */
+	if (top->level != -1 || GetStrideQueue(top) != strideQ) {
+		if (top->level == -1 && top->nrunning == 0) {
+			PushStrideQueue(GetStrideQueue(top), top);
+		}
+		return 1;
+	}
+
+	/* If this process is dead */
+	if (LiveLWP(top) == 0) {
+		LeaveStride(top);
+		return 1;
+	}
+
+	return 0;
+}
+
+struct procParse* SearchStrideQueue(struct StrideQueue* strideQ, int cpu){
 	int originalSize = strideQ->size;
 
 	if (originalSize == 0) {
@@ -191,7 +224,7 @@ struct procParse* SearchStrideQueue(struct StrideQueue* strideQ){
 	struct procParse* top = 0;
 	struct procParse* ret = 0;
 
-	/* If process is alive but not runnable, save it.
+	/* If process is alive but not runnable on cpu, save it.
 	 * Then push again at last.
 	 * Because if push again immediately,
 	 * this process(alive but not runnable) will be chosen again. */
@@ -203,21 +236,11 @@ struct procParse* SearchStrideQueue(struct StrideQueue* strideQ){
 		top = GetTopStrideQueue(strideQ);
 		PopStrideQueue(strideQ);
 
-		/* If this process is dead or not scheduled by stride scheduler. */
-		if (top->p->state == UNUSED || top->p->state == ZOMBIE
-				 || top->level != -1) {
-			/* Give ticket back to global ticket */
-			acquire(&ticketbox.lock);
-			ticketbox.ticket += top->ticket;
-			release(&ticketbox.lock);
-
-			/* Initialize top */
-			top->pass = 0;
-			top->stride = 0;
-			top->ticket = 0;
-			// Don't touch MLFQ's information.
+		/* If this process is dead or not scheduled by this queue. */
+		if (StaleStrideQueue(strideQ, top)) {
+			continue;
 		}
-		else if (top->p->state == RUNNABLE) { // There are RUNNABLE
+		else if (RunnableOn(top, cpu)) { // There are RUNNABLE for cpu
 			ret = top;
 			break;
 		}
@@ -234,3 +257,213 @@ struct procParse* SearchStrideQueue(struct StrideQueue* strideQ){
 
 	return ret;
 }
+
+/* Heap pp is scheduled from while it is under the stride scheduler */
+struct StrideQueue* GetStrideQueue(struct procParse* pp){
+	if (pp->shareGroup != 0) {
+		return &pp->shareGroup->members;
+	}
+	return &strideQ;
+}
+
+/* First pass of a process or group newly under the stride scheduler.
+ * The lowest pass of strideQ and the groups, or MLFQ's if lower. */
+uint64 MinPassStride(uint64 mlfqPass){
+	struct procParse* top;
+	struct ShareGroup* g;
+	uint64 minPass = mlfqPass;
+
+	/* If process at the top is dead, remove it and look again. */
+	while ((top = GetTopStrideQueue(&strideQ)) != 0) {
+		PopStrideQueue(&strideQ);
+		if (!StaleStrideQueue(&strideQ, top)) {
+			/* Regardless of whether process is runnable or not,
+			 * Just get the minimum pass */
+			PushStrideQueue(&strideQ, top);
+			break;
+		}
+	}
+	if (top != 0 && PASSBEFORE(top->pass, minPass)) {
+		minPass = top->pass;
+	}
+
+	for (g = shareGroups; g < &shareGroups[NSHAREGROUP]; g++) {
+		if (g->ticket != 0 && PASSBEFORE(g->pass, minPass)) {
+			minPass = g->pass;
+		}
+	}
+
+	return minPass;
+}
+
+/* Whether no process waits in the stride scheduler */
+int EmptyStride(void){
+	struct ShareGroup* g;
+
+	if (strideQ.size != 0) {
+		return 0;
+	}
+	for (g = shareGroups; g < &shareGroups[NSHAREGROUP]; g++) {
+		if (g->ticket != 0 && g->members.size != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Process of the stride scheduler to run next on cpu, taken out of
+ * its heap. A process holding tickets of the whole cpu competes with
+ * its own pass, a group member with its group's pass, which is set in
+ * pass. Groups are only searched if their pass is lower. */
+struct procParse* SearchStride(uint64* pass, int cpu){
+	struct procParse* ret = SearchStrideQueue(&strideQ, cpu);
+	struct procParse* pp;
+	struct ShareGroup* g;
+
+	if (ret != 0) {
+		*pass = ret->pass;
+	}
+
+	for (g = shareGroups; g < &shareGroups[NSHAREGROUP]; g++) {
+		if (g->ticket == 0 || g->members.size == 0) {
+			continue;
+		}
+		if (ret != 0 && !PASSBEFORE(g->pass, *pass)) {
+			continue;
+		}
+		if ((pp = SearchStrideQueue(&g->members, cpu)) == 0) {
+			continue;
+		}
+
+		if (ret != 0) {
+			PushStrideQueue(GetStrideQueue(ret), ret);
+		}
+		ret = pp;
+		*pass = g->pass;
+	}
+
+	/* Members joining later start from here */
+	if (ret != 0 && ret->shareGroup != 0) {
+		ret->shareGroup->memberPass = ret->pass;
+	}
+
+	return ret;
+}
+
+/* Take pp out of the heap it is in, if any.
+ * It takes O(n), but is only needed when pp leaves the heap. */
+static void RemoveStrideQueue(struct procParse* pp){
+	struct StrideQueue* strideQ = pp->strideQueued;
+	struct procParse* rest[NPROC];
+	struct procParse* top;
+	int n = 0;
+
+	if (strideQ == 0) {
+		return;
+	}
+
+	while ((top = GetTopStrideQueue(strideQ)) != 0) {
+		PopStrideQueue(strideQ);
+		if (top != pp) {
+			rest[n++] = top;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		PushStrideQueue(strideQ, rest[i]);
+	}
+}
+
+/* Take pp out of the stride scheduler and give its tickets back,
+ * to the whole cpu or to its group.
+ * A group whose last member left gives back its own.
+ * Caller must hold ptable.lock. */
+void LeaveStride(struct procParse* pp){
+	struct ShareGroup* g = pp->shareGroup;
+
+	RemoveStrideQueue(pp);
+
+	acquire(&ticketbox.lock);
+	if (g == 0) {
+		ticketbox.ticket += pp->ticket;
+	}
+	else if (--g->nmember == 0) {
+		ticketbox.ticket += g->ticket;
+		g->ticket = 0;
+	}
+	release(&ticketbox.lock);
+
+	/* Initialize pp */
+	pp->shareGroup = 0;
+	pp->pass = 0;
+	pp->stride = 0;
+	pp->ticket = 0;
+	// Don't touch MLFQ's information.
+}
+
+/* Make a share group holding ticket tickets of the whole cpu.
+ * Returns its id, or -1 if the tickets are not free.
+ * Caller must hold ptable.lock. */
+int MakeShareGroup(int ticket, uint64 minPass){
+	struct ShareGroup* g;
+
+	for (g = shareGroups; g < &shareGroups[NSHAREGROUP]; g++) {
+		if (g->ticket == 0) {
+			break;
+		}
+	}
+	if (g == &shareGroups[NSHAREGROUP]) {
+		return -1;
+	}
+
+	acquire(&ticketbox.lock);
+	if (ticket > ticketbox.ticket) {
+		release(&ticketbox.lock);
+		return -1;
+	}
+	ticketbox.ticket -= ticket;
+	release(&ticketbox.lock);
+
+	g->ticket = ticket;
+	g->stride = STRIDE1 / ticket;
+	g->pass = minPass;
+	g->memberPass = 0;
+	g->nmember = 0;
+	InitStrideQueue(&g->members);
+
+	return g - shareGroups;
+}
+
+/* Make pp a member of group gid, with ticket tickets of the group.
+ * If pp is a member already, only its tickets change.
+ * pp must not be in MLFQ. Caller must hold ptable.lock. */
+int JoinShareGroup(struct procParse* pp, int gid, int ticket){
+	struct ShareGroup* g;
+
+	if (gid < 0 || gid >= NSHAREGROUP || ticket <= 0 || ticket > 100) {
+		return -1;
+	}
+	g = &shareGroups[gid];
+	if (g->ticket == 0) {
+		return -1;
+	}
+
+	if (pp->shareGroup != g) {
+		if (pp->level == -1) {
+			LeaveStride(pp);
+		}
+		pp->shareGroup = g;
+		g->nmember++;
+		pp->pass = g->memberPass;
+	}
+
+	pp->ticket = ticket;
+	pp->stride = STRIDE1 / ticket;
+	pp->level = -1;
+	pp->usedTick = 0;
+	pp->usedQuantumTick = 0;
+
+	if (pp->nrunning == 0) {
+		PushStrideQueue(&g->members, pp);
+	}
+	return gid;
+}
@@ -4,11 +4,33 @@
 #include "procparse.h"
 #include "param.h"
 
+/* Passes are 64 bit fixed point numbers.
+ * Holding t tickets, a pass advances by STRIDE1 / t each tick. */
+#define STRIDE1 (1 << 20)
+
+/* Whether pass a is lower than pass b.
+ * Passes are compared by their difference, so they may wrap around. */
+#define PASSBEFORE(a, b) ((int64)((a) - (b)) < 0)
+
 struct StrideQueue{
 	struct procParse* minPassHeap[NPROC + 1]; // Not use 0 index
 	int size;
 };
 
+/* A share group holds tickets of the whole cpu like a process does,
+ * and is scheduled by its own pass. Its members split its share by
+ * their tickets, which only count inside the group. */
+struct ShareGroup{
+	int ticket; // Tickets of the whole cpu, 0 if the group is unused
+	uint64 pass;
+	uint64 stride;
+	uint64 memberPass; // Pass of the member picked last
+	int nmember;
+	struct StrideQueue members; // Members waiting to be picked
+};
+
+extern struct ShareGroup shareGroups[NSHAREGROUP];
+
 void InitStrideQueue(struct StrideQueue* strideQ);
 
 void PushStrideQueue(struct StrideQueue* strideQ, struct procParse* pp);
@@ -18,8 +40,19 @@ struct procParse* GetTopStrideQueue(struct StrideQueue* strideQ);
 int InsertStrideQueue(struct StrideQueue* strideQ,
 						  struct procParse* pp,
 						  int ticket,
-						  double minPass);
+						  uint64 minPass);
+
+struct procParse* SearchStrideQueue(struct StrideQueue* strideQ, int cpu);
+
+/* The whole stride scheduler: processes holding tickets of the whole
+ * cpu in strideQ, and the share groups */
+struct StrideQueue* GetStrideQueue(struct procParse* pp);
+uint64 MinPassStride(uint64 mlfqPass);
+int EmptyStride(void);
+struct procParse* SearchStride(uint64* pass, int cpu);
+void LeaveStride(struct procParse* pp);
 
-struct procParse* SearchStrideQueue(struct StrideQueue* strideQ);
+int MakeShareGroup(int ticket, uint64 minPass);
+int JoinShareGroup(struct procParse* pp, int gid, int ticket);
 
 #endif // STRIDEQUEUE_H
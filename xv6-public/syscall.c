@@ -17,7 +17,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
 
   if(addr >= curproc->sz || addr+4 > curproc->sz) {
   	  //cprintf("addr: %p, curproc->sz: %p\n", addr, curproc->sz);
@@ -35,7 +35,7 @@ int
 fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
 
   if(addr >= curproc->sz)
     return -1;
@@ -62,20 +62,45 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
+  uint a;
  
   if(argint(n, &i) < 0)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  // Fault in demand-zero pages now, so running out of memory
+  // fails the system call instead of a fault in the kernel.
+  for(a = PGROUNDDOWN((uint)i); a < (uint)i+size; a += PGSIZE)
+    if(pagefault(a, 0, 1) < 0)
+      return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes that the kernel will write.
+// Like argptr(), but shared pages are copied and read-only ones
+// refused now, so the writes can't fault while a spinlock is held.
+int
+argout(int n, char **pp, int size)
+{
+  uint a;
+
+  if(argptr(n, pp, size) < 0)
+    return -1;
+  for(a = PGROUNDDOWN((uint)*pp); a < (uint)*pp+size; a += PGSIZE)
+    if(pagefault(a, 1, 1) < 0)
+      return -1;
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Other lwps of the process can still change the string while the
+// kernel uses it, so callers must not trust its length. A string
+// whose nul is overwritten ends at the scratch page pagefault() maps
+// above sz, at the latest, and the process is killed then.)
 int
 argstr(int n, char **pp)
 {
@@ -119,6 +144,18 @@ extern int sys_sync(void);
 extern int sys_get_log_num(void);
 extern int sys_pread(void);
 extern int sys_pwrite(void);
+extern int sys_schedtrace(void);
+extern int sys_getpstat(void);
+extern int sys_profctl(void);
+extern int sys_profread(void);
+extern int sys_lockstat(void);
+extern int sys_share_group(void);
+extern int sys_join_share_group(void);
+extern int sys_set_lwp_share(void);
+extern int sys_set_realtime(void);
+extern int sys_set_nice(void);
+extern int sys_set_affinity(void);
+extern int sys_set_gang(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -155,6 +192,18 @@ static int (*syscalls[])(void) = {
 [SYS_get_log_num]		sys_get_log_num,
 [SYS_pread]				sys_pread,
 [SYS_pwrite]			sys_pwrite,
+[SYS_schedtrace]	sys_schedtrace,
+[SYS_getpstat]		sys_getpstat,
+[SYS_profctl]		sys_profctl,
+[SYS_profread]		sys_profread,
+[SYS_lockstat]		sys_lockstat,
+[SYS_share_group]	sys_share_group,
+[SYS_join_share_group]	sys_join_share_group,
+[SYS_set_lwp_share]	sys_set_lwp_share,
+[SYS_set_realtime]	sys_set_realtime,
+[SYS_set_nice]		sys_set_nice,
+[SYS_set_affinity]	sys_set_affinity,
+[SYS_set_gang]		sys_set_gang,
 };
 
 void
@@ -165,7 +214,9 @@ syscall(void)
 
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
-    curproc->tf->eax = syscalls[num]();
+    // exec() may move the lwp into the ptable slot
+    num = syscalls[num]();
+    myproc()->tf->eax = num;
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
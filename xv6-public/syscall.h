@@ -33,3 +33,15 @@
 #define SYS_get_log_num		32
 #define SYS_pread			33
 #define SYS_pwrite			34
+#define SYS_schedtrace		35
+#define SYS_getpstat		36
+#define SYS_profctl			37
+#define SYS_profread		38
+#define SYS_lockstat		39
+#define SYS_share_group		40
+#define SYS_join_share_group	41
+#define SYS_set_lwp_share	42
+#define SYS_set_realtime	43
+#define SYS_set_nice		44
+#define SYS_set_affinity	45
+#define SYS_set_gang		46
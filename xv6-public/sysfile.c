@@ -6,6 +6,7 @@
 
 #include "types.h"
 #include "defs.h"
+#include "x86.h"
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
@@ -18,6 +19,8 @@
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// Another lwp may close the descriptor during the system call, so
+// the caller gets a reference of its own and drops it with fileclose.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -26,28 +29,28 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=filepin(&myproc()->group->ofile[fd])) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
+// The table is shared by the process's lwps, so a slot is
+// claimed atomically.
 static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
 
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(curproc->ofile[fd] == 0 &&
+       cmpxchg((uint*)&curproc->ofile[fd], 0, (uint)f) == 0)
       return fd;
-    }
   }
   return -1;
 }
@@ -60,9 +63,11 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  // The new descriptor takes over argfd's reference
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -70,52 +75,72 @@ int
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    r = -1;
+  else
+    r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 int
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0)
     return -1;
-  return filewrite(f, p, n);
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    r = -1;
+  else
+    r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 int
 sys_pread(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
   uint offset;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0
-		  || argint(3, (int*)&offset) < 0)
+  if(argfd(0, 0, &f) < 0)
     return -1;
-  return filepread(f, p, n, offset);
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0
+		  || argint(3, (int*)&offset) < 0)
+    r = -1;
+  else
+    r = filepread(f, p, n, offset);
+  fileclose(f);
+  return r;
 }
 
 int
 sys_pwrite(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
   uint offset;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0
-		  || argint(3, (int*)&offset) < 0)
+  if(argfd(0, 0, &f) < 0)
     return -1;
-  return filepwrite(f, p, n, offset);
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0
+		  || argint(3, (int*)&offset) < 0)
+    r = -1;
+  else
+    r = filepwrite(f, p, n, offset);
+  fileclose(f);
+  return r;
 }
 
 int
@@ -126,8 +151,13 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
+  // Another lwp may be closing it too
+  if(cmpxchg((uint*)&myproc()->group->ofile[fd], (uint)f, 0) != (uint)f){
+    fileclose(f);
+    return -1;
+  }
+  fileclose(f);   // the descriptor's reference
+  fileclose(f);   // argfd's
   return 0;
 }
 
@@ -136,10 +166,16 @@ sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  if(argptr(1, (void*)&st, sizeof(*st)) < 0)
+    r = -1;
+  else
+    r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -402,7 +438,6 @@ sys_chdir(void)
 {
   char *path;
   struct inode *ip;
-  struct proc *curproc = myproc();
   
   begin_op();
   if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
@@ -416,9 +451,8 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  iput(cwdswap(ip));
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
@@ -462,7 +496,7 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      myproc()->group->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
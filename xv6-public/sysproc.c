@@ -7,7 +7,9 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "seqlock.h"
 #include "procparse.h"
+#include "pstat.h"
 
 extern uint ticks;
 
@@ -16,6 +18,8 @@ extern struct {
   struct proc proc[NPROC];
 } ptable;
 
+extern struct procParse ppTable[NPROC];
+
 int
 sys_fork(void)
 {
@@ -62,18 +66,20 @@ sys_sbrk(void)
 {
   int addr;
   int n;
+  struct procParse* pp;
 
   if(argint(0, &n) < 0)
     return -1;
 
   // Process's memory size must be protected
-  acquire(&ptable.lock);
-  addr = myproc()->sz;
+  pp = ppTable + (myproc()->group - ptable.proc);
+  acquiresleep(&pp->lock);
+  addr = myproc()->group->sz;
   if(growproc(n) < 0) {
-    release(&ptable.lock);
+    releasesleep(&pp->lock);
   	return -1;
   }
-  release(&ptable.lock);
+  releasesleep(&pp->lock);
   return addr;
 }
 
@@ -85,16 +91,16 @@ sys_sleep(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
+  acquire(&tickslock.lk);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
     if(myproc()->killed){
-      release(&tickslock);
+      release(&tickslock.lk);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&ticks, &tickslock.lk);
   }
-  release(&tickslock);
+  release(&tickslock.lk);
   return 0;
 }
 
@@ -103,21 +109,38 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
+  uint xticks, seq;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
+  do {
+    seq = readseqbegin(&tickslock);
+    xticks = ticks;
+  } while(readseqretry(&tickslock, seq));
   return xticks;
 }
 
 int
 sys_yield(void) {
 	addticks(ticks); // Before giving up CPU, increase tick info
+	myproc()->nvcsw++;
 	yield(); // give up using cpu
 	return 0;
 }
 
+int
+sys_getpstat(void) {
+	int n;
+	struct PStat* ps;
+
+	// No more lwps than this can exist, and n * size can't overflow
+	if (argint(1, &n) < 0 || n < 0 || n > NPROC * NTHREADPAGE * NTHREAD) {
+		return -1;
+	}
+	if (argout(0, (char**)&ps, n * sizeof(struct PStat)) < 0) {
+		return -1;
+	}
+	return getpstat(ps, n);
+}
+
 int
 sys_getlev(void) {
 	return getlev();
@@ -128,6 +151,77 @@ sys_set_cpu_share(void) {
 	return set_cpu_share();
 }
 
+int
+sys_share_group(void) {
+	int ticket;
+
+	if (argint(0, &ticket) < 0) {
+		return -1;
+	}
+	return share_group(ticket);
+}
+
+int
+sys_join_share_group(void) {
+	int gid, ticket;
+
+	if (argint(0, &gid) < 0 || argint(1, &ticket) < 0) {
+		return -1;
+	}
+	return join_share_group(gid, ticket);
+}
+
+int
+sys_set_lwp_share(void) {
+	int tid, share;
+
+	if (argint(0, &tid) < 0 || argint(1, &share) < 0) {
+		return -1;
+	}
+	return set_lwp_share(tid, share);
+}
+
+int
+sys_set_realtime(void) {
+	int runtime, period, deadline;
+
+	if (argint(0, &runtime) < 0 || argint(1, &period) < 0 ||
+		argint(2, &deadline) < 0) {
+		return -1;
+	}
+	return set_realtime(runtime, period, deadline);
+}
+
+int
+sys_set_nice(void) {
+	int nice;
+
+	if (argint(0, &nice) < 0) {
+		return -1;
+	}
+	return set_nice(nice);
+}
+
+int
+sys_set_affinity(void) {
+	int tid, mask;
+
+	if (argint(0, &tid) < 0 || argint(1, &mask) < 0) {
+		return -1;
+	}
+	return set_affinity(tid, mask);
+}
+
+int
+sys_set_gang(void) {
+	int on;
+
+	if (argint(0, &on) < 0) {
+		return -1;
+	}
+	return set_gang(on);
+}
+
 int
 sys_thread_create(void) {
 	return thread_create();
@@ -0,0 +1,123 @@
+/**
+ * This program checks cpu affinity.
+ * A process pinned to a cpu, its lwps and its children must only
+ * run there.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define LIFETIME		(50)	/* (ticks) */
+#define COUNT_PERIOD	(1000000)	/* (iteration) */
+#define NPSTAT			(64)
+
+struct PStat ps[NPSTAT];
+
+/**
+ * Cpu the calling lwp runs on, -1 if it is not found.
+ */
+int
+mycpu(void)
+{
+	int n, i, pid = getpid(), tid = gettid();
+
+	n = getpstat(ps, NPSTAT);
+	for (i = 0; i < n; i++) {
+		if (ps[i].pid == pid && ps[i].tid == tid) {
+			return ps[i].cpu;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Spin for LIFETIME ticks, checking the cpu every period.
+ * Returns how many times it was elsewhere than cpu.
+ */
+int
+spinon(int cpu)
+{
+	int moved = 0;
+	int i = 0;
+	int start_tick = uptime();
+
+	for (;;) {
+		i++;
+		if (i >= COUNT_PERIOD) {
+			i = 0;
+			if (mycpu() != cpu) {
+				moved++;
+			}
+			if (uptime() - start_tick > LIFETIME) {
+				break;
+			}
+		}
+	}
+	return moved;
+}
+
+void*
+lwpmain(void* arg)
+{
+	thread_exit((void*)spinon((int)arg));
+	return 0;
+}
+
+/**
+ * Pin the process to cpu, then check it, a new lwp and a child.
+ */
+int
+pintest(int cpu)
+{
+	thread_t t;
+	void* retval;
+	int moved;
+
+	if (set_affinity(-1, 1 << cpu) != 0) {
+		return -1;
+	}
+
+	moved = spinon(cpu);
+	if (thread_create(&t, lwpmain, (void*)cpu) != 0) {
+		printf(1, "FAIL : thread_create\n");
+		exit();
+	}
+	thread_join(t, &retval);
+	moved += (int)retval;
+
+	if (fork() == 0) {
+		if (spinon(cpu) != 0) {
+			printf(1, "FAIL : child ran off cpu %d\n", cpu);
+		}
+		exit();
+	}
+	wait();
+
+	printf(1, "CPU(%d), moved : %d\n", cpu, moved);
+	if (moved != 0) {
+		printf(1, "FAIL : ran off cpu %d\n", cpu);
+		exit();
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (set_affinity(-1, 0) >= 0 || set_affinity(9999, 1) >= 0) {
+		printf(1, "FAIL : set_affinity accepted bad arguments\n");
+		exit();
+	}
+
+	if (pintest(0) < 0) {
+		printf(1, "FAIL : set_affinity\n");
+		exit();
+	}
+	/* Only if there is a second cpu */
+	pintest(1);
+
+	printf(1, "OK : lwps stayed on their cpu\n");
+	exit();
+}
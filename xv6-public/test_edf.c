@@ -0,0 +1,179 @@
+/**
+ * This program checks the real-time class.
+ * A periodic task must wake up on time next to compute bound MLFQ
+ * processes, and must not run more than its runtime each period.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define LIFETIME		(300)	/* (ticks) */
+#define COUNT_PERIOD	(1000000)	/* (iteration) */
+#define NHOG			(3)
+#define NPSTAT			(64)
+
+struct PStat ps[NPSTAT];
+
+/**
+ * Spin for lifetime ticks and return how many periods were counted.
+ */
+int
+spin(int lifetime)
+{
+	int cnt = 0;
+	int i = 0;
+	int start_tick = uptime();
+
+	for (;;) {
+		i++;
+		if (i >= COUNT_PERIOD) {
+			cnt++;
+			i = 0;
+			if (uptime() - start_tick > lifetime) {
+				break;
+			}
+		}
+	}
+	return cnt;
+}
+
+/**
+ * Ticks the calling process ran for, -1 if it is not found.
+ */
+int
+myticks(void)
+{
+	int n, i, pid = getpid();
+
+	n = getpstat(ps, NPSTAT);
+	for (i = 0; i < n; i++) {
+		if (ps[i].pid == pid) {
+			return ps[i].ticks;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Bad parameters, and more than the free share, must fail
+ * without moving the caller.
+ */
+int
+argtest(void)
+{
+	if (set_realtime(5, 10, 4) >= 0 || set_realtime(2, 1, 2) >= 0 ||
+		set_realtime(-1, 10, 10) >= 0 ||
+		set_realtime(30000000, 30000000, 30000000) >= 0) {
+		printf(1, "FAIL : set_realtime accepted bad parameters\n");
+		return -1;
+	}
+	if (set_realtime(9, 10, 10) >= 0) {
+		printf(1, "FAIL : set_realtime admitted 90%% of the cpu\n");
+		return -1;
+	}
+	if (getlev() < 0) {
+		printf(1, "FAIL : left MLFQ after failed calls\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Wake up every tick while the hogs run. An MLFQ process would wait
+ * for a level 2 quantum to end, a real-time task must not.
+ */
+void
+latency(void)
+{
+	int i, t0, late, maxlate = 0;
+
+	if (set_realtime(5, 10, 10) != 0) {
+		printf(1, "FAIL : set_realtime\n");
+		exit();
+	}
+	if (getlev() != -2) {
+		printf(1, "FAIL : not in the real-time class\n");
+		exit();
+	}
+
+	for (i = 0; i < 100; i++) {
+		t0 = uptime();
+		sleep(1);
+		late = uptime() - t0 - 1;
+		if (late > maxlate) {
+			maxlate = late;
+		}
+	}
+
+	printf(1, "EDF(5/10) woke up at most %d ticks late\n", maxlate);
+	if (maxlate > 3) {
+		printf(1, "FAIL : real-time task waited behind MLFQ\n");
+		exit();
+	}
+	printf(1, "OK : real-time task ran on time\n");
+	exit();
+}
+
+/**
+ * A compute bound task only gets its runtime each period.
+ */
+void
+throttle(void)
+{
+	int ticks;
+
+	if (set_realtime(1, 10, 10) != 0) {
+		printf(1, "FAIL : set_realtime\n");
+		exit();
+	}
+	spin(100);
+	ticks = myticks();
+
+	printf(1, "EDF(1/10) ran %d ticks in 100\n", ticks);
+	if (ticks <= 0 || ticks > 100 / 10 + 3) {
+		printf(1, "FAIL : real-time task overran its runtime\n");
+		exit();
+	}
+	if (set_realtime(0, 0, 0) != 0 || getlev() < 0) {
+		printf(1, "FAIL : did not go back to MLFQ\n");
+		exit();
+	}
+	printf(1, "OK : real-time task kept to its runtime\n");
+	exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i;
+
+	if (argtest() < 0) {
+		exit();
+	}
+
+	for (i = 0; i < NHOG; i++) {
+		if (fork() == 0) {
+			spin(LIFETIME);
+			exit();
+		}
+	}
+	/* Let the hogs sink to level 2 */
+	sleep(100);
+
+	if (fork() == 0) {
+		latency();
+	}
+	wait();
+
+	if (fork() == 0) {
+		throttle();
+	}
+	wait();
+
+	for (i = 0; i < NHOG; i++) {
+		wait();
+	}
+	exit();
+}
@@ -0,0 +1,106 @@
+/**
+ * This program checks gang scheduling.
+ * Two lwps take turns, each waiting for the other, next to MLFQ
+ * processes that keep the cpus busy. With set_gang() both lwps run
+ * in the same slices, so the turns must go at least a quarter faster.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS			(20000)	/* (turns) */
+#define MINTICKS		(4)	/* (ticks) without gang, to compare at all */
+#define NHOG			(3)
+#define COUNT_PERIOD	(1000000)	/* (iteration) */
+
+volatile int turn;
+
+void*
+player(void* arg)
+{
+	int me = (int)arg;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		while (turn % 2 != me)
+			;
+		turn++;
+	}
+	thread_exit(0);
+	return 0;
+}
+
+/**
+ * Play ROUNDS turns on each side, return how many ticks it took.
+ */
+int
+play(void)
+{
+	thread_t t[2];
+	void* retval;
+	int i, start_tick = uptime();
+
+	turn = 0;
+	for (i = 0; i < 2; i++) {
+		if (thread_create(&t[i], player, (void*)i) != 0) {
+			printf(1, "FAIL : thread_create\n");
+			exit();
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		thread_join(t[i], &retval);
+	}
+	if (turn != ROUNDS * 2) {
+		printf(1, "FAIL : %d turns, wanted %d\n", turn, ROUNDS * 2);
+		exit();
+	}
+	return uptime() - start_tick;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int pids[NHOG], i, j, alone, gang;
+
+	for (i = 0; i < NHOG; i++) {
+		if ((pids[i] = fork()) == 0) {
+			for (j = 0; ; j++) {
+				if (j >= COUNT_PERIOD) {
+					j = 0;
+				}
+			}
+		}
+	}
+
+	alone = play();
+	if (set_gang(1) != 0) {
+		printf(1, "FAIL : set_gang\n");
+		exit();
+	}
+	gang = play();
+	if (set_gang(0) != 0) {
+		printf(1, "FAIL : set_gang(0)\n");
+		exit();
+	}
+
+	for (i = 0; i < NHOG; i++) {
+		kill(pids[i]);
+	}
+	for (i = 0; i < NHOG; i++) {
+		wait();
+	}
+
+	printf(1, "ticks without gang : %d, with gang : %d\n", alone, gang);
+	if (alone < MINTICKS) {
+		printf(1, "FAIL : turns took %d ticks without gang, "
+				  "too few to compare\n", alone);
+		exit();
+	}
+	if (gang * 4 > alone * 3) {
+		printf(1, "FAIL : gang was not faster\n");
+		exit();
+	}
+	printf(1, "OK : gang played the turns faster\n");
+	exit();
+}
@@ -0,0 +1,227 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define BIGSIZE (64 * 1024 * 1024)
+#define NTEST 4
+
+// Test a large sbrk succeeds and only touched pages are used
+int sparsetest(void);
+
+// Test fork copies a heap with untouched holes
+int forktest(void);
+
+// Test system calls can read and write untouched pages
+int syscalltest(void);
+
+// Test writes to shared program pages stay private
+int cowtest(void);
+
+int gpipe[2];
+
+int (*testfunc[NTEST])(void) = {
+  sparsetest,
+  forktest,
+  syscalltest,
+  cowtest,
+};
+char *testname[NTEST] = {
+  "sparsetest",
+  "forktest",
+  "syscalltest",
+  "cowtest",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int ret;
+  int pid;
+  int start = 0;
+  int end = NTEST-1;
+  if (argc >= 2)
+    start = atoi(argv[1]);
+  if (argc >= 3)
+    end = atoi(argv[2]);
+
+  for (i = start; i <= end; i++){
+    printf(1,"%d. %s start\n", i, testname[i]);
+    if (pipe(gpipe) < 0){
+      printf(1,"pipe panic\n");
+      exit();
+    }
+    ret = 0;
+
+    if ((pid = fork()) < 0){
+      printf(1,"fork panic\n");
+      exit();
+    }
+    if (pid == 0){
+      close(gpipe[0]);
+      ret = testfunc[i]();
+      write(gpipe[1], (char*)&ret, sizeof(ret));
+      close(gpipe[1]);
+      exit();
+    } else{
+      close(gpipe[1]);
+      if (wait() == -1 || read(gpipe[0], (char*)&ret, sizeof(ret)) == -1 || ret != 0){
+        printf(1,"%d. %s panic\n", i, testname[i]);
+        exit();
+      }
+      close(gpipe[0]);
+    }
+    printf(1,"%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
+
+// ============================================================================
+int
+sparsetest(void)
+{
+  char *p;
+  int i;
+
+  if ((p = sbrk(BIGSIZE)) == (char*)-1){
+    printf(1, "sbrk(%d) failed\n", BIGSIZE);
+    return -1;
+  }
+
+  // Untouched pages read as zero
+  for (i = 0; i < BIGSIZE; i += 1024 * PGSIZE){
+    if (p[i] != 0){
+      printf(1, "page at %d is not zero\n", i);
+      return -1;
+    }
+    p[i] = (char)(i >> 12);
+  }
+  for (i = 0; i < BIGSIZE; i += 1024 * PGSIZE){
+    if (p[i] != (char)(i >> 12)){
+      printf(1, "page at %d lost its value\n", i);
+      return -1;
+    }
+  }
+
+  if (sbrk(-BIGSIZE) == (char*)-1){
+    printf(1, "sbrk(-%d) failed\n", BIGSIZE);
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+int
+forktest(void)
+{
+  char *p;
+  int fds[2];
+  int pid;
+  char c;
+
+  if ((p = sbrk(16 * PGSIZE)) == (char*)-1 || pipe(fds) < 0){
+    printf(1, "sbrk or pipe failed\n");
+    return -1;
+  }
+  p[3 * PGSIZE] = 'a';
+
+  if ((pid = fork()) < 0){
+    printf(1, "fork failed\n");
+    return -1;
+  }
+  if (pid == 0){
+    // Touched page is copied, the holes still fault in as zero
+    c = (p[3 * PGSIZE] == 'a' && p[5 * PGSIZE] == 0) ? 'y' : 'n';
+    p[5 * PGSIZE] = 'b';
+    write(fds[1], &c, 1);
+    exit();
+  }
+  close(fds[1]);
+  if (read(fds[0], &c, 1) != 1 || c != 'y'){
+    printf(1, "child sees wrong heap\n");
+    return -1;
+  }
+  wait();
+  close(fds[0]);
+
+  if (p[5 * PGSIZE] != 0){
+    printf(1, "child wrote parent's page\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+int
+syscalltest(void)
+{
+  char *p;
+  int fds[2];
+
+  if ((p = sbrk(8 * PGSIZE)) == (char*)-1){
+    printf(1, "sbrk failed\n");
+    return -1;
+  }
+  if (pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    return -1;
+  }
+
+  // write() from an untouched page, read() into another one
+  if (write(fds[1], p + PGSIZE, 10) != 10){
+    printf(1, "write from untouched page failed\n");
+    return -1;
+  }
+  if (read(fds[0], p + 6 * PGSIZE, 10) != 10 || p[6 * PGSIZE] != 0){
+    printf(1, "read into untouched page failed\n");
+    return -1;
+  }
+  close(fds[0]);
+  close(fds[1]);
+  return 0;
+}
+
+// ============================================================================
+// Initialized data, mapped from the program file
+char gdata[3 * PGSIZE] = "program data";
+
+int
+cowtest(void)
+{
+  int fds[2];
+  int pid;
+  char c;
+
+  if (pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    return -1;
+  }
+
+  if ((pid = fork()) < 0){
+    printf(1, "fork failed\n");
+    return -1;
+  }
+  if (pid == 0){
+    strcpy(gdata, "child data");
+    // The kernel writes into a shared page as well
+    write(fds[1], "k", 1);
+    read(fds[0], gdata + PGSIZE, 1);
+    c = (strcmp(gdata, "child data") == 0 && gdata[PGSIZE] == 'k') ? 'y' : 'n';
+    write(fds[1], &c, 1);
+    exit();
+  }
+  wait();
+  close(fds[1]);
+  if (read(fds[0], &c, 1) != 1 || c != 'y'){
+    printf(1, "child's writes were lost\n");
+    return -1;
+  }
+  close(fds[0]);
+
+  if (strcmp(gdata, "program data") != 0 || gdata[PGSIZE] != 0){
+    printf(1, "child wrote parent's page\n");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,231 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NUM_THREAD 8
+#define NALLOC 64
+#define NROUND 200
+#define NTEST 3
+#define NSIZE 10
+
+// Test blocks of every size class and large blocks keep their contents
+int sizetest(void);
+
+// Test many threads allocating and freeing at the same time
+int concurrenttest(void);
+
+// Test blocks freed by another thread can be used again
+int crossfreetest(void);
+
+int gpipe[2];
+
+int (*testfunc[NTEST])(void) = {
+  sizetest,
+  concurrenttest,
+  crossfreetest,
+};
+char *testname[NTEST] = {
+  "sizetest",
+  "concurrenttest",
+  "crossfreetest",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int ret;
+  int pid;
+  int start = 0;
+  int end = NTEST-1;
+  if (argc >= 2)
+    start = atoi(argv[1]);
+  if (argc >= 3)
+    end = atoi(argv[2]);
+
+  for (i = start; i <= end; i++){
+    printf(1,"%d. %s start\n", i, testname[i]);
+    if (pipe(gpipe) < 0){
+      printf(1,"pipe panic\n");
+      exit();
+    }
+    ret = 0;
+
+    if ((pid = fork()) < 0){
+      printf(1,"fork panic\n");
+      exit();
+    }
+    if (pid == 0){
+      close(gpipe[0]);
+      ret = testfunc[i]();
+      write(gpipe[1], (char*)&ret, sizeof(ret));
+      close(gpipe[1]);
+      exit();
+    } else{
+      close(gpipe[1]);
+      if (wait() == -1 || read(gpipe[0], (char*)&ret, sizeof(ret)) == -1 || ret != 0){
+        printf(1,"%d. %s panic\n", i, testname[i]);
+        exit();
+      }
+      close(gpipe[0]);
+    }
+    printf(1,"%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
+
+// Fill n bytes at p with a pattern derived from key, or check it.
+static void
+fill(char *p, int n, int key)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    p[i] = (char)(key + i);
+}
+
+static int
+check(char *p, int n, int key)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    if (p[i] != (char)(key + i))
+      return -1;
+  return 0;
+}
+
+// ============================================================================
+int
+sizetest(void)
+{
+  static int sizes[NSIZE] = { 1, 8, 24, 100, 500, 1000, 2040, 2041, 5000, 40000 };
+  char *p[NSIZE];
+  int i;
+
+  for (i = 0; i < NSIZE; i++){
+    if ((p[i] = malloc(sizes[i])) == 0){
+      printf(1, "malloc(%d) failed\n", sizes[i]);
+      return -1;
+    }
+    fill(p[i], sizes[i], i);
+  }
+  for (i = 0; i < NSIZE; i++){
+    if (check(p[i], sizes[i], i) != 0){
+      printf(1, "malloc(%d) was overwritten\n", sizes[i]);
+      return -1;
+    }
+    free(p[i]);
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+allocthreadmain(void *arg)
+{
+  char *p[NALLOC];
+  int key = (int)arg;
+  int r, i, n;
+
+  for (r = 0; r < NROUND; r++){
+    for (i = 0; i < NALLOC; i++){
+      n = 1 + (key * 31 + r * 7 + i * 13) % 3000;
+      if ((p[i] = malloc(n)) == 0)
+        thread_exit((void*)-1);
+      fill(p[i], n, key + i);
+    }
+    for (i = 0; i < NALLOC; i++){
+      n = 1 + (key * 31 + r * 7 + i * 13) % 3000;
+      if (check(p[i], n, key + i) != 0)
+        thread_exit((void*)-1);
+      free(p[i]);
+    }
+  }
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+concurrenttest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i;
+  void *retval;
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], allocthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// ============================================================================
+char *gblocks[NUM_THREAD][NALLOC];
+
+void*
+freethreadmain(void *arg)
+{
+  int i;
+  int t = (int)arg;
+
+  // Free the blocks allocated by the main thread for this thread
+  for (i = 0; i < NALLOC; i++){
+    if (check(gblocks[t][i], 100, t + i) != 0)
+      thread_exit((void*)-1);
+    free(gblocks[t][i]);
+  }
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+crossfreetest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i, t;
+  void *retval;
+  char *p;
+
+  for (t = 0; t < NUM_THREAD; t++){
+    for (i = 0; i < NALLOC; i++){
+      if ((gblocks[t][i] = malloc(100)) == 0){
+        printf(1, "malloc failed\n");
+        return -1;
+      }
+      fill(gblocks[t][i], 100, t + i);
+    }
+  }
+
+  for (t = 0; t < NUM_THREAD; t++){
+    if (thread_create(&threads[t], freethreadmain, (void*)t) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (t = 0; t < NUM_THREAD; t++){
+    if (thread_join(threads[t], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+
+  // The main thread can still allocate after the others freed
+  for (i = 0; i < NALLOC; i++){
+    if ((p = malloc(100)) == 0){
+      printf(1, "malloc after cross free failed\n");
+      return -1;
+    }
+    fill(p, 100, i);
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * This program checks nice levels.
+ * Built with make SCHED=cfs, a nice 0 process gets about 9 times
+ * the cpu of a nice 10 one. MLFQ does not look at nice levels.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME		(300)	/* (ticks) */
+#define COUNT_PERIOD	(1000000)	/* (iteration) */
+#define NCHILD			(4)	/* More than the cpus, so they compete */
+
+/**
+ * Spin for LIFETIME ticks and return how many periods were counted.
+ */
+int
+spin(void)
+{
+	int cnt = 0;
+	int i = 0;
+	int start_tick = uptime();
+
+	for (;;) {
+		i++;
+		if (i >= COUNT_PERIOD) {
+			cnt++;
+			i = 0;
+			if (uptime() - start_tick > LIFETIME) {
+				break;
+			}
+		}
+	}
+	return cnt;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, nice;
+
+	if (set_nice(-21) >= 0 || set_nice(20) >= 0) {
+		printf(1, "FAIL : set_nice accepted a bad level\n");
+		exit();
+	}
+
+	for (i = 0; i < NCHILD; i++) {
+		if (fork() == 0) {
+			nice = i % 2 == 0 ? 0 : 10;
+			if (set_nice(nice) != 0) {
+				printf(1, "FAIL : set_nice\n");
+				exit();
+			}
+			printf(1, "NICE(%d), cnt : %d\n", nice, spin());
+			exit();
+		}
+	}
+
+	for (i = 0; i < NCHILD; i++) {
+		wait();
+	}
+	printf(1, "OK : set_nice\n");
+	exit();
+}
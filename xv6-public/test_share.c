@@ -0,0 +1,218 @@
+/**
+ * This program checks share groups of the stride scheduler.
+ * A service gets 40% of the cpu and two workers split it 1:3,
+ * next to a 20% stride process and an MLFQ process.
+ * Then it checks shares of lwps inside a process.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME		(500)	/* (ticks) */
+#define COUNT_PERIOD	(1000000)	/* (iteration) */
+
+/**
+ * Spin for LIFETIME ticks and return how many periods were counted.
+ */
+int
+spin(void)
+{
+	int cnt = 0;
+	int i = 0;
+	int start_tick = uptime();
+
+	for (;;) {
+		i++;
+		if (i >= COUNT_PERIOD) {
+			cnt++;
+			i = 0;
+			if (uptime() - start_tick > LIFETIME) {
+				break;
+			}
+		}
+	}
+	return cnt;
+}
+
+/**
+ * Bad arguments must fail without moving the caller.
+ */
+int
+argtest(void)
+{
+	if (share_group(0) >= 0 || share_group(101) >= 0) {
+		printf(1, "FAIL : share_group accepted a bad ticket\n");
+		return -1;
+	}
+	if (join_share_group(-1, 1) >= 0 || join_share_group(100, 1) >= 0) {
+		printf(1, "FAIL : join_share_group accepted a bad group\n");
+		return -1;
+	}
+	if (getlev() < 0) {
+		printf(1, "FAIL : left MLFQ after failed calls\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Worker of the service, with ticket tickets of the group.
+ * Reports its count through fd.
+ */
+void
+worker(int gid, int ticket, int fd)
+{
+	int cnt;
+
+	if (join_share_group(gid, ticket) != gid) {
+		printf(1, "FAIL : join_share_group\n");
+		exit();
+	}
+	cnt = spin();
+	printf(1, "SHARE(40%%) worker %d tickets, cnt : %d\n", ticket, cnt);
+	write(fd, &cnt, sizeof(cnt));
+	exit();
+}
+
+/**
+ * The service makes the group, then its workers inherit it by fork.
+ */
+void
+service(void)
+{
+	int gid, fds[2], cnt[2], i;
+
+	if ((gid = share_group(40)) < 0) {
+		printf(1, "FAIL : share_group\n");
+		exit();
+	}
+	if (getlev() != -1) {
+		printf(1, "FAIL : service is not under the stride scheduler\n");
+		exit();
+	}
+	if (pipe(fds) < 0) {
+		printf(1, "FAIL : pipe\n");
+		exit();
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (fork() == 0) {
+			close(fds[0]);
+			worker(gid, i == 0 ? 1 : 3, fds[1]);
+		}
+	}
+	close(fds[1]);
+
+	/* The service itself sleeps, the workers split its share */
+	for (i = 0; i < 2; i++) {
+		wait();
+	}
+	if (read(fds[0], &cnt[0], sizeof(int)) != sizeof(int) ||
+		read(fds[0], &cnt[1], sizeof(int)) != sizeof(int)) {
+		printf(1, "FAIL : worker died\n");
+		exit();
+	}
+	close(fds[0]);
+
+	/* The workers finish in any order, the busier counted more */
+	if (cnt[0] > cnt[1]) {
+		i = cnt[0];
+		cnt[0] = cnt[1];
+		cnt[1] = i;
+	}
+	if (cnt[1] < cnt[0] * 2) {
+		printf(1, "FAIL : workers got %d and %d, wanted about 1:3\n",
+				cnt[0], cnt[1]);
+		exit();
+	}
+	printf(1, "OK : workers split the share\n");
+	exit();
+}
+
+int lwpcnt;
+
+void*
+lwpmain(void* arg)
+{
+	if (set_lwp_share(gettid(), 75) != 0) {
+		printf(1, "FAIL : set_lwp_share\n");
+		exit();
+	}
+	lwpcnt = spin();
+	thread_exit(0);
+	return 0;
+}
+
+/**
+ * An lwp with 75% of its process runs about 3 times as much as the
+ * main lwp. A stride process runs one lwp at a time, so the two
+ * compete even with several cpus.
+ */
+void
+lwptest(void)
+{
+	thread_t t;
+	void* retval;
+	int cnt;
+
+	if (set_lwp_share(gettid(), 101) == 0 || set_lwp_share(999, 10) == 0) {
+		printf(1, "FAIL : set_lwp_share accepted bad arguments\n");
+		exit();
+	}
+	if (set_cpu_share(20) != 0) {
+		printf(1, "FAIL : set_cpu_share\n");
+		exit();
+	}
+	if (thread_create(&t, lwpmain, 0) != 0) {
+		printf(1, "FAIL : thread_create\n");
+		exit();
+	}
+	cnt = spin();
+	thread_join(t, &retval);
+
+	printf(1, "LWP(75%%), cnt : %d, LWP(rest), cnt : %d\n", lwpcnt, cnt);
+	if (lwpcnt < cnt * 2) {
+		printf(1, "FAIL : lwps got %d and %d, wanted about 3:1\n",
+				lwpcnt, cnt);
+		exit();
+	}
+	printf(1, "OK : lwps split the process's share\n");
+	exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i;
+
+	if (argtest() < 0) {
+		exit();
+	}
+
+	if (fork() == 0) {
+		service();
+	}
+	if (fork() == 0) {
+		if (set_cpu_share(20) != 0) {
+			printf(1, "FAIL : set_cpu_share\n");
+			exit();
+		}
+		printf(1, "STRIDE(20%%), cnt : %d\n", spin());
+		exit();
+	}
+	if (fork() == 0) {
+		printf(1, "MLFQ(compute), cnt : %d\n", spin());
+		exit();
+	}
+
+	for (i = 0; i < 3; i++) {
+		wait();
+	}
+
+	if (fork() == 0) {
+		lwptest();
+	}
+	wait();
+	exit();
+}
@@ -0,0 +1,181 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NUM_THREAD 4
+#define NLINE 200
+#define NTEST 2
+
+// Test what is written through a FILE reads back the same
+int filetest(void);
+
+// Test lines written by many threads are never torn
+int threadtest(void);
+
+int gpipe[2];
+
+int (*testfunc[NTEST])(void) = {
+  filetest,
+  threadtest,
+};
+char *testname[NTEST] = {
+  "filetest",
+  "threadtest",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int ret;
+  int pid;
+  int start = 0;
+  int end = NTEST-1;
+  if (argc >= 2)
+    start = atoi(argv[1]);
+  if (argc >= 3)
+    end = atoi(argv[2]);
+
+  for (i = start; i <= end; i++){
+    printf(1,"%d. %s start\n", i, testname[i]);
+    if (pipe(gpipe) < 0){
+      printf(1,"pipe panic\n");
+      exit();
+    }
+    ret = 0;
+
+    if ((pid = fork()) < 0){
+      printf(1,"fork panic\n");
+      exit();
+    }
+    if (pid == 0){
+      close(gpipe[0]);
+      ret = testfunc[i]();
+      write(gpipe[1], (char*)&ret, sizeof(ret));
+      close(gpipe[1]);
+      exit();
+    } else{
+      close(gpipe[1]);
+      if (wait() == -1 || read(gpipe[0], (char*)&ret, sizeof(ret)) == -1 || ret != 0){
+        printf(1,"%d. %s panic\n", i, testname[i]);
+        exit();
+      }
+      close(gpipe[0]);
+    }
+    printf(1,"%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
+
+// ============================================================================
+int
+filetest(void)
+{
+  FILE *f;
+  char line[32];
+  int i, c, n;
+
+  if ((f = fopen("stdiofile", "w")) == 0){
+    printf(1, "fopen for write failed\n");
+    return -1;
+  }
+  for (i = 0; i < NLINE; i++)
+    fprintf(f, "line %d\n", i);
+  if (fclose(f) != 0){
+    printf(1, "fclose failed\n");
+    return -1;
+  }
+
+  if ((f = fopen("stdiofile", "r")) == 0){
+    printf(1, "fopen for read failed\n");
+    return -1;
+  }
+  for (i = 0; i < NLINE; i++){
+    n = 0;
+    while ((c = fgetc(f)) != EOF && c != '\n')
+      line[n++] = c;
+    line[n] = 0;
+    if (c == EOF || atoi(line + 5) != i){
+      printf(1, "line %d read back as '%s'\n", i, line);
+      return -1;
+    }
+  }
+  if (fgetc(f) != EOF || !feof(f)){
+    printf(1, "no EOF at end of file\n");
+    return -1;
+  }
+  fclose(f);
+  unlink("stdiofile");
+  return 0;
+}
+
+// ============================================================================
+FILE *gfile;
+
+void*
+printthreadmain(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NLINE; i++)
+    fprintf(gfile, "thread %d line %d\n", (int)arg, i);
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+threadtest(void)
+{
+  thread_t threads[NUM_THREAD];
+  char line[32];
+  void *retval;
+  int i, c, n, nline;
+
+  if ((gfile = fopen("stdiofile", "w")) == 0){
+    printf(1, "fopen for write failed\n");
+    return -1;
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], printthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+  fclose(gfile);
+
+  if ((gfile = fopen("stdiofile", "r")) == 0){
+    printf(1, "fopen for read failed\n");
+    return -1;
+  }
+  nline = 0;
+  n = 0;
+  while ((c = fgetc(gfile)) != EOF){
+    if (c != '\n'){
+      if (n < sizeof(line) - 1)
+        line[n++] = c;
+      continue;
+    }
+    line[n] = 0;
+    if (strlen(line) < 15 || line[0] != 't' || line[8] != ' '){
+      printf(1, "torn line '%s'\n", line);
+      return -1;
+    }
+    nline++;
+    n = 0;
+  }
+  fclose(gfile);
+  unlink("stdiofile");
+
+  if (nline != NUM_THREAD * NLINE){
+    printf(1, "%d lines instead of %d\n", nline, NUM_THREAD * NLINE);
+    return -1;
+  }
+  return 0;
+}
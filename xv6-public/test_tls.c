@@ -0,0 +1,205 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NUM_THREAD 10
+#define NTEST 3
+
+// Test every thread gets its own TLS page
+int privatetest(void);
+
+// Test TLS survives thread switches inside the process
+int switchtest(void);
+
+// Test TLS pages are handed out again after join
+int reusetest(void);
+
+int gpipe[2];
+
+int (*testfunc[NTEST])(void) = {
+  privatetest,
+  switchtest,
+  reusetest,
+};
+char *testname[NTEST] = {
+  "privatetest",
+  "switchtest",
+  "reusetest",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int ret;
+  int pid;
+  int start = 0;
+  int end = NTEST-1;
+  if (argc >= 2)
+    start = atoi(argv[1]);
+  if (argc >= 3)
+    end = atoi(argv[2]);
+
+  for (i = start; i <= end; i++){
+    printf(1,"%d. %s start\n", i, testname[i]);
+    if (pipe(gpipe) < 0){
+      printf(1,"pipe panic\n");
+      exit();
+    }
+    ret = 0;
+
+    if ((pid = fork()) < 0){
+      printf(1,"fork panic\n");
+      exit();
+    }
+    if (pid == 0){
+      close(gpipe[0]);
+      ret = testfunc[i]();
+      write(gpipe[1], (char*)&ret, sizeof(ret));
+      close(gpipe[1]);
+      exit();
+    } else{
+      close(gpipe[1]);
+      if (wait() == -1 || read(gpipe[0], (char*)&ret, sizeof(ret)) == -1 || ret != 0){
+        printf(1,"%d. %s panic\n", i, testname[i]);
+        exit();
+      }
+      close(gpipe[0]);
+    }
+    printf(1,"%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
+
+// ============================================================================
+void*
+privatethreadmain(void *arg)
+{
+  int *tls = gettls();
+
+  // Word 0 is the self pointer, use the rest
+  tls[1] = (int)arg;
+  sleep(10);
+  if (tls[1] != (int)arg)
+    thread_exit((void*)-1);
+
+  thread_exit(tls);
+
+  return 0;
+}
+
+int
+privatetest(void)
+{
+  thread_t threads[NUM_THREAD];
+  void *retval[NUM_THREAD];
+  int i, j;
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], privatethreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval[i]) != 0 || (int)retval[i] == -1){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+    if (retval[i] == gettls()){
+      printf(1, "thread %d shares main thread's TLS\n", i);
+      return -1;
+    }
+  }
+
+  // Live threads must never have shared a page
+  for (i = 0; i < NUM_THREAD; i++){
+    for (j = i + 1; j < NUM_THREAD; j++){
+      if (retval[i] == retval[j]){
+        printf(1, "thread %d and %d share TLS\n", i, j);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+switchthreadmain(void *arg)
+{
+  int *tls = gettls();
+  int i;
+
+  for (i = 0; i < 1000; i++){
+    tls[1] = (int)arg + i;
+    yield();
+    if (tls[1] != (int)arg + i || gettls() != tls)
+      thread_exit((void*)-1);
+  }
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+switchtest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i;
+  void *retval;
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], switchthreadmain, (void*)(i * 10000)) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+reusethreadmain(void *arg)
+{
+  int *tls = gettls();
+
+  // A recycled page must still start with its own address
+  if (tls[0] != (int)tls)
+    thread_exit((void*)-1);
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+reusetest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i, n;
+  void *retval;
+
+  for (n = 0; n < 100; n++){
+    for (i = 0; i < NUM_THREAD; i++){
+      if (thread_create(&threads[i], reusethreadmain, 0) != 0){
+        printf(1, "panic at thread_create\n");
+        return -1;
+      }
+    }
+    for (i = 0; i < NUM_THREAD; i++){
+      if (thread_join(threads[i], &retval) != 0 || retval != 0){
+        printf(1, "panic at thread_join\n");
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include "defs.h"
 #include "x86.h"
 #include "spinlock.h"
+#include "memlayout.h"
+#include "stridequeue.h"
 
 extern struct {
   struct spinlock lock;
@@ -13,14 +15,16 @@ extern void trapret(void);
 
 extern uint ticks; // for debugging
 
-struct Thread*
-AllocThread(struct procParse* pp)
+// Caller holds pp->lock, unless pp is a new process nobody sees yet.
+// The scheduler may walk the pages meanwhile, so a slot is only
+// published, by setting its p, once the lwp in it is set up.
+// The lwp gets a kernel stack if kstack is set.
+static struct Thread*
+NewThread(struct procParse* pp, int kstack)
 {
   struct proc *p;
   char *sp;
 
-  acquire(&ptable.lock);
-
   // tid is unsigned short
   // If required tid is more than 65535, 
   // reset tid to 1
@@ -41,13 +45,13 @@ AllocThread(struct procParse* pp)
 		if (pg == 0) {
 			// If there are no page, allocate new page
 			if ((pg = (struct ThreadPage*)kalloc()) == 0) {
-				release(&ptable.lock);
 				cprintf("AllocThread err: kalloc failed\n");
 				return 0;
 			}
 
-			pp->threadDir[i] = pg; // Push page into directory
 			memset(pg, 0, PGSIZE); // Initialize to 0
+			__sync_synchronize();
+			pp->threadDir[i] = pg; // Push page into directory
 		}
 
 		// If page's index is empty, allocate it to the new thread
@@ -58,19 +62,28 @@ AllocThread(struct procParse* pp)
 		}
   }
 
-  release(&ptable.lock);
   return 0;
 
 found:
-  nt->p = &(nt->lwp); // new thread point proc in the thread
-  nt->tid = pp->tid++; // Set new thread's tid info
-  memmove(nt->p, pp->p, sizeof(struct proc)); // copy ptable's proc
-
-  p = nt->p; // Inner proc
+  p = &(nt->lwp); // Inner proc
+  memmove(p, pp->p, sizeof(struct proc)); // copy ptable's proc
   p->state = EMBRYO;
-  pg->threadNum++; // page get new thread
-
-  release(&ptable.lock);
+  p->waittsc = 0; // Accounting starts over for the new lwp
+  p->ticks = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  p->lasttick = 0;
+  p->cpu = -1;
+  p->chan = 0;
+  p->thread = nt;
+  nt->share = 0;
+  nt->stride = 0;
+  nt->pass = pp->lwpPass; // Not ahead of the others, nor far behind
+
+  if (!kstack) {
+	p->kstack = 0;
+	goto done;
+  }
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
@@ -94,9 +107,49 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
+done:
+  nt->tid = pp->tid++; // Set new thread's tid info
+  pg->threadNum++; // page get new thread
+  __sync_synchronize();
+  nt->p = p; // new thread point proc in the thread
+
   return nt;
 }
 
+struct Thread*
+AllocThread(struct procParse* pp)
+{
+  return NewThread(pp, 1);
+}
+
+// Thread of a new process's first lwp, which lives in the ptable
+// slot and runs on the slot's kernel stack. 0 if out of memory.
+struct Thread*
+AllocMainThread(struct procParse* pp)
+{
+  return NewThread(pp, 0);
+}
+
+// Empty thread slot t, freeing its kernel stack,
+// and its page if it was the page's last thread.
+// Caller holds ptable.lock, the scheduler walks the pages under it.
+static void
+DropThread(struct procParse* pp, struct Thread* t)
+{
+	int pn = t->pageNum;
+	struct ThreadPage* pg = pp->threadDir[pn];
+
+	kfree(t->lwp.kstack);
+
+	acquirewrite(&threadDirLock);
+	memset(t, 0, sizeof(struct Thread));
+	if (--pg->threadNum == 0) {
+		pp->threadDir[pn] = 0;
+		kfree((char*)pg);
+	}
+	releasewrite(&threadDirLock);
+}
+
 struct ThreadId
 ForkThread(struct procParse* pp, void*(*start_routine)(void*), void* arg)
 {
@@ -106,10 +159,13 @@ ForkThread(struct procParse* pp, void*(*start_routine)(void*), void* arg)
   retId.tid = -1;
 
   struct Thread* newThread;
-  struct proc* curproc = pp->p; // pp->p is ptable's proc
+  struct proc* curproc = myproc(); // Creating lwp
+
+  acquiresleep(&pp->lock);
 
   // Allocate thread.
   if((newThread = AllocThread(pp)) == 0){
+	releasesleep(&pp->lock);
 	cprintf("ForkThread err: AllocThread failed\n");
     return retId; // -1 id return
   }
@@ -119,48 +175,46 @@ ForkThread(struct procParse* pp, void*(*start_routine)(void*), void* arg)
   // Copy trap frame
   *np->tf = *curproc->tf;
 
+  // Runs where its creator may
+  np->cpumask = curproc->cpumask;
+
   // Clear %eax, Set start routine
   //np->tf->eax = 0;
   np->tf->eip = (uint)start_routine;
 
-  // Set file info
-  for(int i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = curproc->ofile[i];
-  np->cwd = curproc->cwd;
-
-  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  // Open files, cwd and sz are shared through the process's slot
 
   // Set user stack
-  // If pp has trash address, recycle it
-  acquire(&ptable.lock);
-
   uint top, sp;
   // If pp has trash address, recycle it
   // cf) address stack has bottom of trash stack. Not a top of trash stack
-  // => this 'top' variable has the top of user stack after allocuvm. 
-  // before allocuvm, it is not a top
+  // => this 'top' variable has the top of user stack after it is adjusted.
+  // before that, it is not a top
   if ((top = GetTopAddrStack(&pp->trashAddrStack)) != 0) {
     PopAddrStack(&pp->trashAddrStack);
 
-	// Using trash address, make new user stack
-  	if((top = allocuvm(curproc->pgdir, top, top + 2 * PGSIZE)) == 0) {
-		release(&ptable.lock);	
-		cprintf("ForkThread err: allocuvm is 0\n");
-		return retId;
+	// Using trash address, make new user stack and TLS page.
+	// Its pages are faulted in on first touch.
+	top += THREAD_USIZE - TLSSIZE; // TLS page is placed above the stack
+	if(setguard(curproc->pgdir, (char*)(top - 2 * PGSIZE)) < 0) {
+		cprintf("ForkThread err: setguard failed\n");
+		goto bad;
 	}
-	clearpteu(curproc->pgdir, (char*)(top - 2 * PGSIZE));
 	sp = top;
 
+	if (SetTls(curproc->pgdir, np, top) < 0) {
+		cprintf("ForkThread err: SetTls failed\n");
+		goto bad;
+	}
+
 	uint ustack[2];
 	ustack[0] = 0xffffffff;
 	ustack[1] = (uint)arg;
 	sp -= 2 * 4;
 
 	if (copyout(curproc->pgdir, sp, ustack, 2 * 4) < 0) {
-		release(&ptable.lock);
 		cprintf("ForkThread err: copyout failed\n");
-		return retId;
+		goto bad;
 	}
 
   	// Commit to the user image.
@@ -170,41 +224,67 @@ ForkThread(struct procParse* pp, void*(*start_routine)(void*), void* arg)
   // If there are no trash address,
   // Allocate new user memory for making new user stack
   else if ((top = SetUstack(pp, newThread, arg)) == -1) {
-  	release(&ptable.lock);
 	cprintf("ForkThread err: SetUstack failed\n");
-	return retId;
+	goto bad;
   }
 
   newThread->ustackTop = top; // Save user stack's top
 
-  np->state = RUNNABLE;
-
+  acquire(&ptable.lock);
+  // The process is exiting or execing, it waits for its lwps to go
+  if (pp->stopper != 0) {
+	release(&ptable.lock);
+	goto bad;
+  }
+  setstate(np, RUNNABLE);
+  np->readytsc = rdtsc();
   release(&ptable.lock);
 
+  releasesleep(&pp->lock);
+
   // Return thread id that has thread's location info
   retId.pageNum = newThread->pageNum;
   retId.tid = newThread->tid;
 
   return retId;
+
+bad:
+  acquire(&ptable.lock);
+  DropThread(pp, newThread);
+  release(&ptable.lock);
+  releasesleep(&pp->lock);
+  return retId;
 }
 
 int
 SetUstack(struct procParse* pp, struct Thread* t, void* arg)
 {
-  struct proc* curproc = pp->p;
-  uint sz, sp, ustack[2]; // start_routine's argument, fake ret addr
+  struct proc* curproc = pp->p; // sz is kept in the ptable slot
+  uint sz, top, sp, ustack[2]; // start_routine's argument, fake ret addr
   pde_t *pgdir = curproc->pgdir;
   sz = curproc->sz;
 
-  // Allocate two pages at the next page boundary.
-  // Make the first inaccessible.  Use the second as the user stack.
+  // Reserve three pages at the next page boundary.
+  // Make the first a guard page.  Use the second as the user stack.
+  // The third is the thread's TLS page.
+  // Pages are faulted in on first touch, not allocated here.
   sz = PGROUNDUP(sz);
-  if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0) {
-    cprintf("SetUstack err: allocuvm failed\n");  
+  if(sz + THREAD_USIZE >= KERNBASE) {
+    cprintf("SetUstack err: out of address space\n");  
+  	return -1;
+  }
+  sz += THREAD_USIZE;
+  top = sz - TLSSIZE;
+  if(setguard(pgdir, (char*)(top - 2*PGSIZE)) < 0) {
+    cprintf("SetUstack err: setguard failed\n");  
+  	return -1;
+  }
+  sp = top;
+
+  if(SetTls(pgdir, t->p, top) < 0) {
+	cprintf("SetUstack err: SetTls failed\n");
   	return -1;
   }
-  clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
-  sp = sz;
 
   // Push start routine, arg
   ustack[0] = 0xffffffff;  // fake return PC
@@ -219,137 +299,379 @@ SetUstack(struct procParse* pp, struct Thread* t, void* arg)
 
   // Commit to the user image.
   curproc->sz = sz; // Set new size of process memory
-  t->p->sz = sz; // Make sz same with ptable's proc
   t->p->tf->esp = sp; // Set trapframe's stack pointer to user stack
 
-  return sz; // return top of user stack
+  return top; // return top of user stack
+}
+
+// Make tls the TLS page of lwp p.
+// The first word of the page points to the page itself,
+// so user code can find its TLS with a single %gs:0 load.
+int
+SetTls(pde_t* pgdir, struct proc* p, uint tls)
+{
+  if(copyout(pgdir, tls, &tls, sizeof(tls)) < 0)
+    return -1;
+
+  p->tlsbase = tls;
+  p->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+
+  return 0;
+}
+
+// Find an lwp of pp in state, searching round robin
+// from the thread after from (from the start if from is 0),
+// so that from itself is checked last.
+// Returns 0 if there is none. Caller holds ptable.lock.
+struct proc*
+FindLWP(struct procParse* pp, struct Thread* from, int state)
+{
+	struct ThreadPage* pg = 0;
+	struct Thread* t = 0;
+	int pn = 0;
+	unsigned int i = 0;
+
+	if (from != 0) {
+		pn = from->pageNum;
+		i = (from->tid % NTHREAD) + 1;
+	}
+
+	// From the thread after from to the end of the directory,
+	// then from the start back to from.
+	for (int n = 0; n <= NTHREADPAGE; n++, pn = (pn + 1) % NTHREADPAGE, i = 0) {
+		if ((pg = pp->threadDir[pn]) == 0) {
+			continue;
+		}
+
+		for (; i < NTHREAD; i++) {
+			t = &(pg->threadArr[i]);
+
+			if (t->p != 0 && t->p->state == state) {
+				return t->p;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Whether pp has a RUNNABLE lwp that may run on cpu.
+// Lwps are only looked at one by one once set_affinity() pinned one.
+// Caller holds ptable.lock.
+int
+RunnableOn(struct procParse* pp, int cpu)
+{
+	struct ThreadPage* pg = 0;
+	struct Thread* t = 0;
+
+	if (pp->nrunnable == 0) {
+		return LentLWP(pp, cpu) != 0;
+	}
+	if (!pp->pinned) {
+		return 1;
+	}
+
+	for (int pn = 0; pn < NTHREADPAGE; pn++) {
+		if ((pg = pp->threadDir[pn]) == 0) {
+			continue;
+		}
+		for (int i = 0; i < NTHREAD; i++) {
+			t = &(pg->threadArr[i]);
+			if (t->p != 0 && t->p->state == RUNNABLE &&
+				(t->p->cpumask & (1 << cpu)) != 0) {
+				return 1;
+			}
+		}
+	}
+	return 0;
 }
 
-// Find thread who has 'state'
-// and change ptable's proc to that thread's proc
-// and return original lwp inside of previous thread
-// If there are no thread who has 'state', do not change. just return 0
+// Lwp to run on cpu in the turn of pp, which has no RUNNABLE lwp but
+// one sleeping on a sleeplock: the lock's holder, or the holder of the
+// lock that one sleeps on, and so on. So the holder gets pp's priority
+// until it releases the lock. Only the stride scheduler and the EDF
+// class lend. MLFQ keeps a process without RUNNABLE lwps in its
+// blocked lists, and the boost bounds an inversion inside MLFQ.
+// Returns 0 if there is none. Caller holds ptable.lock.
 struct proc*
-swap(struct procParse* pp, int state)
+LentLWP(struct procParse* pp, int cpu)
 {
-	if (pp == 0) {
+	struct ThreadPage* pg = 0;
+	struct Thread* t = 0;
+	struct sleeplock* lk;
+	struct proc* h;
+	int n;
+
+	if (pp->level >= 0) {
 		return 0;
 	}
 
-	struct proc* p = pp->p; // get proc at ptable
-	uint sz = p->sz; // save sz from ptable's proc
-
-	/* Save ptable's proc into thread structure */
-	struct Thread* curthread = pp->threadNow;
-	memmove(&(curthread->lwp), p, sizeof(struct proc));
-	
-	// Disconnect thread with ptable's proc
-	// Reconnect with inner proc
-	curthread->p = &(curthread->lwp);
-	
-	/* Search lwp who has 'state'
-	 * after current thread's id */
+	for (int pn = 0; pn < NTHREADPAGE; pn++) {
+		if ((pg = pp->threadDir[pn]) == 0) {
+			continue;
+		}
+		for (int i = 0; i < NTHREAD; i++) {
+			t = &(pg->threadArr[i]);
+			if (t->p == 0 || t->p->state != SLEEPING ||
+				(lk = t->p->waitlock) == 0) {
+				continue;
+			}
+
+			// The lock is read without lk->lk. A holder gone by now
+			// is cleared, or has another tid.
+			for (n = 0; n < NLENDCHAIN; n++) {
+				h = lk->owner;
+				if (h == 0 || h->thread == 0 || h->thread->tid != lk->tid) {
+					break;
+				}
+				if (h->state == RUNNABLE) {
+					if ((h->cpumask & (1 << cpu)) != 0) {
+						return h;
+					}
+					break;
+				}
+				if (h->state != SLEEPING || (lk = h->waitlock) == 0) {
+					break;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// Next RUNNABLE lwp of pp to run on cpu, after from.
+// Round robin, until shares are set on its lwps with set_lwp_share().
+// Then the one with the lowest pass, which advances by the inverse of
+// its share for each tick it runs. Lwps without a share split what
+// the shares leave. A pass behind that of the lwp picked last counts
+// as that one, so an lwp back from sleep does not run for long.
+// Lwps whose cpu mask leaves out cpu are skipped.
+// Returns 0 if there is none. Caller holds ptable.lock.
+struct proc*
+PickLWP(struct procParse* pp, struct Thread* from, int cpu)
+{
 	struct ThreadPage* pg = 0;
-	struct Thread* target = 0;
-	int pn = curthread->pageNum;
-	unsigned int i = (curthread->tid % NTHREAD) + 1;
+	struct Thread* t = 0;
+	struct Thread* best = 0;
+	uint64 pass, bestPass = 0;
+	int pn = 0, nfree = 0, weight;
+	unsigned int i = 0;
+
+	if (pp->lwpShare == 0 && !pp->pinned) {
+		return FindLWP(pp, from, RUNNABLE);
+	}
 
-	// Search lwp who has 'state'
-	for (; pn < NTHREADPAGE; pn++) {
-		pg = pp->threadDir[pn];
+	// Live lwps splitting what the shares leave
+	for (pn = 0; pn < NTHREADPAGE && pp->lwpShare != 0; pn++) {
+		if ((pg = pp->threadDir[pn]) == 0) {
+			continue;
+		}
+		for (i = 0; i < NTHREAD; i++) {
+			t = &(pg->threadArr[i]);
+			if (t->p != 0 && t->share == 0 &&
+				t->p->state != UNUSED && t->p->state != ZOMBIE) {
+				nfree++;
+			}
+		}
+	}
 
-		if (pg == 0) {
+	pn = 0;
+	i = 0;
+	if (from != 0) {
+		pn = from->pageNum;
+		i = (from->tid % NTHREAD) + 1;
+	}
+
+	// Same order as FindLWP(), so that equal passes take turns.
+	// Lwps visited twice do not replace themselves.
+	for (int n = 0; n <= NTHREADPAGE; n++, pn = (pn + 1) % NTHREADPAGE, i = 0) {
+		if ((pg = pp->threadDir[pn]) == 0) {
 			continue;
 		}
-	
+
 		for (; i < NTHREAD; i++) {
-			target = &(pg->threadArr[i]);
-			
-			if (target->p != 0 && target->p->state == state) {
-				/* Connect target thread's proc with ptable */
-				memmove(p, &(target->lwp), sizeof(struct proc));
-				p->sz = sz; // Set last sz
-				target->p = p; // thread points ptable's proc
-				pp->threadNow = target;
-				return &(curthread->lwp); // Return original lwp
+			t = &(pg->threadArr[i]);
+
+			if (t->p == 0 || t->p->state != RUNNABLE ||
+				(t->p->cpumask & (1 << cpu)) == 0) {
+				continue;
+			}
+			if (pp->lwpShare == 0) {
+				return t->p; // Round robin
+			}
+
+			pass = PASSBEFORE(t->pass, pp->lwpPass) ? pp->lwpPass : t->pass;
+			if (best == 0 || PASSBEFORE(pass, bestPass)) {
+				best = t;
+				bestPass = pass;
 			}
 		}
-		
-		// Read all thread in this page. reset i to 0
-		i = 0;
 	}
 
-	/* If serach failed, start from 0 to current thread */
-	for (pn = 0; pn <= curthread->pageNum; pn++) {
-		pg = pp->threadDir[pn];
+	if (best == 0) {
+		return 0;
+	}
 
-		if (pg == 0) {
+	weight = best->share;
+	if (weight == 0) {
+		weight = nfree > 0 ? (100 - pp->lwpShare) / nfree : 1;
+		if (weight < 1) {
+			weight = 1;
+		}
+	}
+	best->stride = STRIDE1 / weight;
+	best->pass = bestPass;
+	pp->lwpPass = bestPass;
+
+	return best->p;
+}
+
+// Number of lwps of pp that are not ZOMBIE yet.
+// The process is gone when there are none.
+int
+LiveLWP(struct procParse* pp)
+{
+	struct ThreadPage* pg = 0;
+	struct Thread* t = 0;
+	int n = 0;
+
+	for (int pn = 0; pn < NTHREADPAGE; pn++) {
+		if ((pg = pp->threadDir[pn]) == 0) {
 			continue;
 		}
-		
-		for(i = 0; i < NTHREAD; i++) {
-			target = &(pg->threadArr[i]);
-
-			if (target->p != 0 && target->p->state == state) {
-				/* Connect target with ptable */
-				memmove(p, &(target->lwp), sizeof(struct proc));
-				p->sz = sz; // Set last size
-				target->p = p; // thread points ptable's proc
-				pp->threadNow = target;
-				return &(curthread->lwp);
+
+		for (int i = 0; i < NTHREAD; i++) {
+			t = &(pg->threadArr[i]);
+
+			if (t->p != 0 && t->p->state != UNUSED && t->p->state != ZOMBIE) {
+				n++;
 			}
 		}
 	}
 
-	// There are no thread who has 'state'
-	// Reconnect current thread with ptable
-	curthread->p = p;
+	return n;
+}
 
-	return 0;
+// Make every other lwp of the current process exit, for exit and exec.
+// They are killed, woken if they sleep, and leave on their way back to
+// user space, so none is stopped while it holds a lock.
+// Caller holds ptable.lock and no sleeplock another lwp might want.
+// Returns -1 if another lwp is already doing this, then the caller
+// should exit itself.
+int
+StopLWPs(struct procParse* pp)
+{
+	struct proc* curproc = myproc();
+	struct ThreadPage* pg = 0;
+	struct Thread* t = 0;
+	int alive;
+
+	if (pp->stopper != 0 && pp->stopper != curproc) {
+		return -1;
+	}
+	pp->stopper = curproc;
+
+	for (;;) {
+		alive = 0;
+		for (int pn = 0; pn < NTHREADPAGE; pn++) {
+			if ((pg = pp->threadDir[pn]) == 0) {
+				continue;
+			}
+
+			for (int i = 0; i < NTHREAD; i++) {
+				t = &(pg->threadArr[i]);
+
+				if (t->p == 0 || t->p == curproc ||
+					t->p->state == UNUSED || t->p->state == ZOMBIE) {
+					continue;
+				}
+				alive++;
+				t->p->killed = 1;
+				if (t->p->state == SLEEPING) {
+					setstate(t->p, RUNNABLE);
+					t->p->readytsc = rdtsc();
+				}
+			}
+		}
+		if (alive == 0) {
+			return 0;
+		}
+
+		// The scheduler wakes us whenever one of them leaves a cpu
+		sleep(&pp->stopper, &ptable.lock);
+	}
+}
+
+// Move the running lwp p into its process's ptable slot,
+// whose own lwp has exited, so it carries on as the first lwp.
+// Only exec does this, after every other lwp is gone.
+// Caller holds ptable.lock.
+void
+MoveLWP(struct proc* p)
+{
+	struct proc* slot = p->group;
+
+	kfree(slot->kstack);
+	slot->kstack = p->kstack;
+	slot->state = p->state;
+	slot->tf = p->tf;
+	slot->context = p->context;
+	slot->chan = p->chan;
+	slot->killed = p->killed;
+	slot->tlsbase = p->tlsbase;
+	slot->readytsc = p->readytsc;
+	slot->waittsc = p->waittsc;
+	slot->ticks = p->ticks;
+	slot->nvcsw = p->nvcsw;
+	slot->nivcsw = p->nivcsw;
+	slot->lasttick = p->lasttick;
+	slot->cpumask = p->cpumask; // The program runs where the caller may
+	slot->cpu = p->cpu;
+	slot->waitlock = p->waitlock;
+	p->kstack = 0; // Not freed with p's thread
+
+	mycpu()->proc = slot;
 }
 
 // At last of join, Remove joining thread
 // Initialize that place to 0
+// Caller holds pp->lock.
 int
 FreeThread(struct procParse* pp, struct Thread* target) {
-	struct proc* curproc = myproc(); // ptable's proc
+	struct proc* curproc = myproc(); // joining lwp
 	struct proc* p = target->p; // proc inside of thread structure
 	if (target->p == curproc) {
-		panic("FreeThread err: removing target is ptable's proc");
+		panic("FreeThread err: removing target is the caller");
 	}
 
 	uint ustackTop = target->ustackTop; // Top of user stack(lwp)
 
-	// To check page's thread number
-	struct ThreadPage* pg = 0;
-	int pn = target->pageNum;
-	
 	// Only remove zombie thread
 	if(p->state != ZOMBIE){
 		cprintf("FreeThread err: target is not ZOMBIE\n");
 		return -1;
 	}
 
-	// free kernel stack
-	kfree(p->kstack);
-
-	// Make this place to 0
-	memset(target, 0, sizeof(struct Thread));
-
-	// If this page has no thread, free it
-	pg = pp->threadDir[pn];
-	if (--pg->threadNum == 0) {
-		pp->threadDir[pn] = 0;
-		kfree((char*)pg);
+	// The first lwp lives in the ptable slot and runs on the
+	// process's own stack, wait() frees them with the process.
+	if (p == pp->p) {
+		return 0;
 	}
 
+	acquire(&ptable.lock);
+	DropThread(pp, target);
+	release(&ptable.lock);
+
 	// Save user stack's bottom for recycling
 	uint bot;
-	bot = deallocuvm(curproc->pgdir, ustackTop, ustackTop - 2 * PGSIZE);
+	acquire(&pp->pglock);
+	bot = deallocuvm(curproc->pgdir, ustackTop + TLSSIZE,
+					 ustackTop + TLSSIZE - THREAD_USIZE);
+	release(&pp->pglock);
 	PushAddrStack(&pp->trashAddrStack, bot);
 
-	// Reload cr3 for resetting TLB register
-	switchuvm(curproc);
+	// Other lwps may still have the stack's pages in their tlb
+	shootdown(curproc->pgdir);
 
 	return 0;
 }
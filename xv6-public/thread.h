@@ -3,15 +3,35 @@
 
 #include "procparse.h"
 
+// Every lwp's user area is a guard page, a stack page and a TLS page.
+// ustackTop is the boundary between the stack and the TLS page.
+#define THREAD_USIZE (2 * PGSIZE + TLSSIZE)
+
 struct ThreadId ForkThread(struct procParse* pp, 
 						  void* (*start_routine)(void*),
 						  void* arg);
 
 struct Thread* AllocThread(struct procParse* pp);
 
+struct Thread* AllocMainThread(struct procParse* pp);
+
 int SetUstack(struct procParse* pp, struct Thread* t, void* arg);
 
-struct proc* swap(struct procParse* pp, int state);
+int SetTls(pde_t* pgdir, struct proc* p, uint tls);
+
+struct proc* FindLWP(struct procParse* pp, struct Thread* from, int state);
+
+int RunnableOn(struct procParse* pp, int cpu);
+
+struct proc* LentLWP(struct procParse* pp, int cpu);
+
+struct proc* PickLWP(struct procParse* pp, struct Thread* from, int cpu);
+
+int LiveLWP(struct procParse* pp);
+
+int StopLWPs(struct procParse* pp);
+
+void MoveLWP(struct proc* p);
 
 int FreeThread(struct procParse* pp, struct Thread* target);
 
@@ -1,7 +1,6 @@
 #ifndef THREADTYPES_H
 #define THREADTYPES_H
 
-#define NTHREAD (26) // Thread's size is 152 bytes.
 #define NTHREADPAGE (10)
 
 struct ThreadId {
@@ -19,8 +18,16 @@ struct Thread {
 	struct Thread* tail; // Used join tree
 	void* retval;
 	uint ustackTop; // user stack's top address
+
+	// Share of the process's cpu time, see PickLWP()
+	int share; // Percent set with set_lwp_share(), 0 if not set
+	uint stride; // Charged per tick, set when picked
+	uint64 pass;
 };
 
+// As many threads as fit in a page after threadNum
+#define NTHREAD ((PGSIZE - sizeof(int)) / sizeof(struct Thread))
+
 struct ThreadPage {
 	int threadNum;
 	struct Thread threadArr[NTHREAD];
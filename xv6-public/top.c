@@ -0,0 +1,130 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+// Show what every lwp is doing, refreshed every interval.
+//
+// usage: top [ticks [count]]
+//   Sample getpstat() every ticks timer ticks (default 100),
+//   count times (default 10). %CPU and the switch and wait
+//   columns cover the last interval; TICKS is the lwp's total.
+
+#define NPSTAT 256
+
+struct PStat cur[NPSTAT], prev[NPSTAT];
+int ncur, nprev;
+
+char *states[] = {
+  [0] "unused",
+  [1] "embryo",
+  [2] "sleep",
+  [3] "runble",
+  [4] "run",
+  [5] "zombie",
+};
+
+// Print s left aligned in a column of width w.
+static void
+lcol(char *s, int w)
+{
+  int n = strlen(s);
+
+  printf(1, "%s", s);
+  for(; n < w; n++)
+    printf(1, " ");
+}
+
+// Print v right aligned in a column of width w.
+static void
+rcol(int v, int w)
+{
+  int n, x;
+
+  n = v < 0 ? 2 : 1;
+  for(x = v; x >= 10 || x <= -10; x /= 10)
+    n++;
+  for(; n < w; n++)
+    printf(1, " ");
+  printf(1, " %d", v);
+}
+
+// The previous sample of the same lwp, or 0 if it is new.
+static struct PStat*
+before(struct PStat *s)
+{
+  int i;
+
+  for(i = 0; i < nprev; i++)
+    if(prev[i].pid == s->pid && prev[i].tid == s->tid)
+      return &prev[i];
+  return 0;
+}
+
+static void
+show(int interval)
+{
+  static struct PStat zero;
+  struct PStat *s, *b;
+  int i, nrun;
+
+  nrun = 0;
+  for(i = 0; i < ncur; i++)
+    if(cur[i].state == 3 || cur[i].state == 4)
+      nrun++;
+  printf(1, "\nuptime %d, %d lwps, %d runnable\n", uptime(), ncur, nrun);
+  printf(1, "  PID  TID STATE  CPU CLASS  TKT   PASS  TICKS %%CPU  VCSW IVCSW WAITK NAME\n");
+
+  for(i = 0; i < ncur; i++){
+    s = &cur[i];
+    if((b = before(s)) == 0)
+      b = &zero;
+
+    rcol(s->pid, 4);
+    rcol(s->tid, 4);
+    printf(1, " ");
+    lcol(s->state < sizeof(states)/sizeof(states[0]) ? states[s->state] : "???", 6);
+    rcol(s->cpu, 3);
+    if(s->level == -2)
+      printf(1, " edf   ");
+    else if(s->level < 0)
+      printf(1, " stride");
+    else
+      printf(1, " mlfq%d ", s->level);
+    rcol(s->level < 0 ? s->ticket : 0, 4);
+    rcol(s->pass, 6);
+    rcol(s->ticks, 6);
+    rcol((s->ticks - b->ticks) * 100 / interval, 4);
+    rcol(s->nvcsw - b->nvcsw, 5);
+    rcol(s->nivcsw - b->nivcsw, 5);
+    // Wait time in units of 1024 cycles keeps the arithmetic in 32 bits
+    rcol((uint)((s->waittsc - b->waittsc) >> 10), 5);
+    printf(1, " %s\n", s->name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval, count, i;
+
+  interval = argc >= 2 ? atoi(argv[1]) : 100;
+  count = argc >= 3 ? atoi(argv[2]) : 10;
+  if(interval <= 0 || count <= 0){
+    printf(2, "usage: top [ticks [count]]\n");
+    exit();
+  }
+
+  nprev = getpstat(prev, NPSTAT);
+  for(i = 0; i < count; i++){
+    sleep(interval);
+    if((ncur = getpstat(cur, NPSTAT)) < 0){
+      printf(2, "top: getpstat failed\n");
+      exit();
+    }
+    show(interval);
+    memmove(prev, cur, ncur * sizeof(cur[0]));
+    nprev = ncur;
+  }
+  exit();
+}
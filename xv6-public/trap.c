@@ -7,12 +7,14 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "seqlock.h"
+#include "schedtrace.h"
 #include "thread.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
+struct seqlock tickslock;
 uint ticks;
 
 // For debugging
@@ -32,7 +34,7 @@ tvinit(void)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
 
-  initlock(&tickslock, "time");
+  initseqlock(&tickslock, "time");
 }
 
 void
@@ -58,11 +60,19 @@ trap(struct trapframe *tf)
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
     if(cpuid() == 0){
-      acquire(&tickslock);
+      acquireseq(&tickslock);
       ticks++;
+      releaseseq(&tickslock);
+      // Not inside the write section, which uptime readers spin on.
+      // sys_sleep() checks ticks holding tickslock.lk, so it can't
+      // miss this wakeup.
       wakeup(&ticks);
-      release(&tickslock);
 	}
+    ProfileTick(tf);
+    lapiceoi();
+    break;
+  case T_TLBFLUSH:
+    tlbintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -87,6 +97,13 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Page not faulted in yet or shared copy-on-write,
+    // otherwise a real fault.
+    if(pagefault(rcr2(), tf->err & FEC_WR, (tf->cs&3) == 0) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -116,6 +133,8 @@ trap(struct trapframe *tf)
   	/* Scheule only if the process consumed entire time quantum. */
 	addticks(ticks);
 	if (checkquantum()) {
+		TraceSched(TRACE_PREEMPT, myproc()->pid, gettid(), getlev(), 0);
+		myproc()->nivcsw++;
 		yield();
 	}
 	else {
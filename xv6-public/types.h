@@ -2,6 +2,8 @@
 #define TYPES_H
 
 typedef unsigned int   uint;
+typedef unsigned long long uint64;
+typedef long long int64;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
 typedef uint pde_t;
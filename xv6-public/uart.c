@@ -14,15 +14,31 @@
 
 #define COM1    0x3f8
 
+#define UART_TX_BUF 512   // bytes waiting to be sent
+#define LSR_RXREADY 0x01  // input is waiting to be read
+#define LSR_TXEMPTY 0x20  // transmitter can take more
+
 static int uart;    // is there a uart?
+static int fifo;    // bytes the transmitter takes at once
+
+// Output goes into tx and the transmit interrupt sends it,
+// so writers don't wait for the line.
+static struct {
+  struct spinlock lock;
+  char buf[UART_TX_BUF];
+  uint r;  // Send index
+  uint w;  // Write index
+} tx;
 
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on and clear the FIFO, if it is a 16550.
+  outb(COM1+2, 0x07);
 
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -30,7 +46,7 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  outb(COM1+1, 0x03);    // Enable receive and transmit interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -39,7 +55,7 @@ uartinit(void)
 
   // Acknowledge pre-existing interrupt conditions;
   // enable interrupts.
-  inb(COM1+2);
+  fifo = (inb(COM1+2) & 0xC0) == 0xC0 ? 16 : 1;
   inb(COM1+0);
   ioapicenable(IRQ_COM1, 0);
 
@@ -48,14 +64,74 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Hand the transmitter as much of tx as it takes now.
+// Caller holds tx.lock.
+static void
+uartstart(void)
+{
+  int i;
+
+  if(!(inb(COM1+5) & LSR_TXEMPTY))
+    return;  // the transmit interrupt will call again
+  for(i = 0; i < fifo && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % UART_TX_BUF]);
+}
+
+// tx is full. Wait for the line like uartputc used to,
+// which also works with interrupts off.
+// After a timeout the FIFO may still be full, so only one
+// byte goes out, as uartputc sent it.
+// Caller holds tx.lock.
+static void
+uartwait(void)
+{
+  int i, n;
+
+  for(i = 0; i < 128 && !(inb(COM1+5) & LSR_TXEMPTY); i++)
+    microdelay(10);
+  n = (inb(COM1+5) & LSR_TXEMPTY) ? fifo : 1;
+  for(i = 0; i < n && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % UART_TX_BUF]);
+}
+
+// Append n bytes to tx and start sending them.
+void
+uartwrite(char *buf, int n)
+{
+  int i;
+
+  if(!uart)
+    return;
+  acquire(&tx.lock);
+  for(i = 0; i < n; i++){
+    if(tx.w - tx.r == UART_TX_BUF)
+      uartwait();
+    tx.buf[tx.w++ % UART_TX_BUF] = buf[i];
+  }
+  uartstart();
+  release(&tx.lock);
+}
+
 void
 uartputc(int c)
+{
+  char ch = c;
+
+  uartwrite(&ch, 1);
+}
+
+// Send c right away, after whatever is still in tx.
+// For panic(), which can't take locks or wait for interrupts.
+void
+uartputc_sync(int c)
 {
   int i;
 
   if(!uart)
     return;
-  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
+  while(tx.r != tx.w)
+    uartwait();
+  for(i = 0; i < 128 && !(inb(COM1+5) & LSR_TXEMPTY); i++)
     microdelay(10);
   outb(COM1+0, c);
 }
@@ -65,7 +141,7 @@ uartgetc(void)
 {
   if(!uart)
     return -1;
-  if(!(inb(COM1+5) & 0x01))
+  if(!(inb(COM1+5) & LSR_RXREADY))
     return -1;
   return inb(COM1+0);
 }
@@ -73,5 +149,10 @@ uartgetc(void)
 void
 uartintr(void)
 {
+  inb(COM1+2);  // acknowledge a transmit interrupt
   consoleintr(uartgetc);
+
+  acquire(&tx.lock);
+  uartstart();
+  release(&tx.lock);
 }
@@ -104,3 +104,16 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Return this thread's TLS page (TLSSIZE bytes).
+// The kernel stores the page's own address in its first word,
+// so it can be reached through %gs without knowing the base.
+// malloc owns the last TLSMALLOC bytes, see user.h.
+void*
+gettls(void)
+{
+  void *tls;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (tls));
+  return tls;
+}
@@ -2,89 +2,340 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "x86.h"
 
-// Memory allocator by Kernighan and Ritchie,
+// Thread-aware memory allocator.
+//
+// Small requests are rounded up to one of NCLASS size classes.
+// Blocks of a class are carved out of whole pages and kept on
+// free lists: a lock-free cache in each thread's TLS page, backed
+// by a global list per class. A thread only takes the global lock
+// when its cache runs empty or grows past its limit, and then moves
+// a batch of blocks at once. thread_exit() gives the cache back.
+//
+// Large requests bypass the classes and get whole pages.
+// Free pages are kept in an address-ordered list of runs which
+// are coalesced like the allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+// New pages come from sbrk() in page-sized chunks.
+
+#define PGSIZE    4096
+#define NCLASS    8             // 16, 32, ..., 2048 bytes
+#define MINCLASS  16            // smallest block, header included
+#define MAXCLASS  (MINCLASS << (NCLASS - 1))
+#define BATCH     8             // blocks moved between cache and global
+#define TCACHEMAX 2048          // bytes a thread may cache per class
+#define LARGE     0x80000000    // header size flag for page blocks
+#define NMOREPAGE 16            // pages asked from sbrk at a time
+#define NSPIN     100           // tries before lock() yields
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;          // next free block of the same class
+    uint size;                  // class index, or page count | LARGE
   } s;
   Align x;
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+// A run of free pages, stored in its first page.
+struct run {
+  struct run *next;
+  uint npages;
+};
 
-void
-free(void *ap)
+// Per-thread cache. It lives in the last TLSMALLOC bytes of the
+// thread's TLS page, which the kernel hands out zero-filled.
+struct tcache {
+  Header *list[NCLASS];
+  uint count[NCLASS];
+};
+
+// Fails to compile if the cache outgrows what user.h sets aside
+typedef char tcachefits[sizeof(struct tcache) <= TLSMALLOC ? 1 : -1];
+
+static struct {
+  volatile uint locked;
+  Header *list[NCLASS];         // global free blocks per class
+  struct run *runs;             // free pages, sorted by address
+} heap;
+
+static void
+lock(void)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
+  int i;
+
+  // The holder is likely running on another cpu and done soon,
+  // so spin a little. If it still holds the lock, it may have
+  // been preempted, and another thread runs instead.
+  for(i = 0; xchg(&heap.locked, 1) != 0; i++){
+    if(i < NSPIN)
+      pause();
+    else {
+      yield();
+      i = 0;
+    }
+  }
+}
+
+static void
+unlock(void)
+{
+  xchg(&heap.locked, 0);
+}
+
+static struct tcache*
+mycache(void)
+{
+  return (struct tcache*)((char*)gettls() + TLSSIZE - TLSMALLOC);
+}
+
+static uint
+classsize(int c)
+{
+  return MINCLASS << c;
+}
+
+// Return the class for nbytes of payload, or -1 if it is large.
+static int
+sizeclass(uint nbytes)
+{
+  uint need;
+  int c;
+
+  need = nbytes + sizeof(Header);
+  if(need < nbytes || need > MAXCLASS)
+    return -1;
+  for(c = 0; classsize(c) < need; c++)
+    ;
+  return c;
+}
+
+// Put the run of npages at v back into heap.runs.
+// Caller holds the lock.
+static void
+freepages(void *v, uint npages)
+{
+  struct run *r, *p, *prev;
+
+  r = (struct run*)v;
+  r->npages = npages;
+
+  prev = 0;
+  for(p = heap.runs; p != 0 && p < r; p = p->next)
+    prev = p;
+
+  // Coalesce with the following run.
+  if(p != 0 && (char*)r + r->npages * PGSIZE == (char*)p){
+    r->npages += p->npages;
+    r->next = p->next;
   } else
-    p->s.ptr = bp;
-  freep = p;
+    r->next = p;
+
+  // Coalesce with the preceding run.
+  if(prev != 0 && (char*)prev + prev->npages * PGSIZE == (char*)r){
+    prev->npages += r->npages;
+    prev->next = r->next;
+  } else if(prev != 0)
+    prev->next = r;
+  else
+    heap.runs = r;
 }
 
-static Header*
-morecore(uint nu)
+// Grow the heap by at least npages pages.
+// Caller holds the lock.
+static int
+morepages(uint npages)
 {
   char *p;
-  Header *hp;
+  uint brk, n;
+
+  // Keep runs page aligned even if someone sbrk()ed an odd size.
+  brk = (uint)sbrk(0);
+  if(brk % PGSIZE != 0 && sbrk(PGSIZE - brk % PGSIZE) == (char*)-1)
+    return -1;
+
+  // Ask for a bigger chunk, but settle for what is needed.
+  n = npages < NMOREPAGE ? NMOREPAGE : npages;
+  if((p = sbrk(n * PGSIZE)) == (char*)-1){
+    n = npages;
+    if(npages >= NMOREPAGE || (p = sbrk(n * PGSIZE)) == (char*)-1)
+      return -1;
+  }
+  freepages(p, n);
+  return 0;
+}
+
+// First fit from heap.runs. Caller holds the lock.
+static void*
+allocpages(uint npages)
+{
+  struct run *r, *prev;
+  int retried;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  for(retried = 0; ; retried = 1){
+    prev = 0;
+    for(r = heap.runs; r != 0; prev = r, r = r->next){
+      if(r->npages < npages)
+        continue;
+      if(r->npages == npages){
+        if(prev)
+          prev->next = r->next;
+        else
+          heap.runs = r->next;
+        return r;
+      }
+      // Hand out the tail, the head stays in place.
+      r->npages -= npages;
+      return (char*)r + r->npages * PGSIZE;
+    }
+    if(retried || morepages(npages) < 0)
+      return 0;
+  }
+}
+
+// Refill the global list of class c with one fresh page.
+// Caller holds the lock.
+static int
+carve(int c)
+{
+  char *pg;
+  Header *h;
+  uint off, size;
+
+  if((pg = allocpages(1)) == 0)
+    return -1;
+  size = classsize(c);
+  for(off = 0; off + size <= PGSIZE; off += size){
+    h = (Header*)(pg + off);
+    h->s.size = c;
+    h->s.ptr = heap.list[c];
+    heap.list[c] = h;
+  }
+  return 0;
+}
+
+static void*
+malloclarge(uint nbytes)
+{
+  Header *h;
+  uint npages;
+
+  if(nbytes + sizeof(Header) < nbytes)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  npages = (nbytes + sizeof(Header) + PGSIZE - 1) / PGSIZE;
+
+  lock();
+  h = allocpages(npages);
+  unlock();
+  if(h == 0)
+    return 0;
+
+  h->s.size = npages | LARGE;
+  return (void*)(h + 1);
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  struct tcache *tc;
+  Header *h;
+  int c, i;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if((c = sizeclass(nbytes)) < 0)
+    return malloclarge(nbytes);
+
+  tc = mycache();
+  if(tc->list[c] == 0){
+    // Move a batch from the global list into this thread's cache.
+    lock();
+    for(i = 0; i < BATCH; i++){
+      if(heap.list[c] == 0 && carve(c) < 0)
+        break;
+      h = heap.list[c];
+      heap.list[c] = h->s.ptr;
+      h->s.ptr = tc->list[c];
+      tc->list[c] = h;
+      tc->count[c]++;
+    }
+    unlock();
+    if(tc->list[c] == 0)
+      return 0;
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
+
+  h = tc->list[c];
+  tc->list[c] = h->s.ptr;
+  tc->count[c]--;
+  return (void*)(h + 1);
+}
+
+void
+free(void *ap)
+{
+  struct tcache *tc;
+  Header *h;
+  uint c, limit;
+  int i;
+
+  if(ap == 0)
+    return;
+
+  h = (Header*)ap - 1;
+  if(h->s.size & LARGE){
+    lock();
+    freepages(h, h->s.size & ~LARGE);
+    unlock();
+    return;
+  }
+
+  c = h->s.size;
+  tc = mycache();
+  h->s.ptr = tc->list[c];
+  tc->list[c] = h;
+  tc->count[c]++;
+
+  // Give a batch back when the cache is full.
+  limit = TCACHEMAX / classsize(c);
+  if(limit < BATCH)
+    limit = BATCH;
+  if(tc->count[c] <= limit)
+    return;
+
+  lock();
+  for(i = 0; i < BATCH; i++){
+    h = tc->list[c];
+    tc->list[c] = h->s.ptr;
+    tc->count[c]--;
+    h->s.ptr = heap.list[c];
+    heap.list[c] = h;
+  }
+  unlock();
+}
+
+void sys_thread_exit(void*);
+
+// Exit the calling thread. Its cache goes with its TLS page,
+// so the cached blocks are put on the global lists first.
+void
+thread_exit(void *retval)
+{
+  struct tcache *tc;
+  Header *h;
+  int c;
+
+  tc = mycache();
+  lock();
+  for(c = 0; c < NCLASS; c++){
+    while((h = tc->list[c]) != 0){
+      tc->list[c] = h->s.ptr;
+      h->s.ptr = heap.list[c];
+      heap.list[c] = h;
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+    tc->count[c] = 0;
   }
+  unlock();
+  sys_thread_exit(retval);
 }
@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct SchedEvent;
+struct PStat;
+struct ProfSample;
+struct LockStat;
 typedef int thread_t;
 
 // system calls
@@ -39,6 +43,18 @@ int sync();
 int get_log_num();
 int pread(int fd, void* buf, int n, unsigned int offset);
 int pwrite(int fd, void* buf, int n, unsigned int offset);
+int schedtrace(int cpu, struct SchedEvent* buf, int n);
+int getpstat(struct PStat* buf, int n);
+int profctl(int on);
+int profread(int cpu, struct ProfSample* buf, int n);
+int lockstat(struct LockStat* buf, int n, int reset);
+int share_group(int ticket);
+int join_share_group(int gid, int ticket);
+int set_lwp_share(int tid, int share);
+int set_realtime(int runtime, int period, int deadline);
+int set_nice(int nice);
+int set_affinity(int tid, int mask);
+int set_gang(int on);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -46,10 +62,41 @@ char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
-void printf(int, const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+// The first word of the TLS page holds its address, and malloc
+// keeps its per-thread cache in the last TLSMALLOC bytes, so
+// threads may use the TLSSIZE - TLSMALLOC bytes in between.
+#define TLSMALLOC 64
+void* gettls(void);
+
+// stdio.c
+#define BUFSIZ 512
+#define EOF (-1)
+#define _IOFBF 0  // fully buffered
+#define _IOLBF 1  // line buffered
+#define _IONBF 2  // unbuffered
+typedef struct stdfile FILE;
+extern FILE *stdin, *stdout, *stderr;
+void printf(int, const char*, ...);
+void fprintf(FILE*, const char*, ...);
+FILE* fopen(const char*, const char*);
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char*, int, int);
+int fileno(FILE*);
+int ferror(FILE*);
+int feof(FILE*);
+int fwrite(const void*, int, int, FILE*);
+int fread(void*, int, int, FILE*);
+int fputc(int, FILE*);
+int fputs(const char*, FILE*);
+int fgetc(FILE*);
+int putc_unlocked(int, FILE*);
+void flockfile(FILE*);
+void funlockfile(FILE*);
@@ -6,6 +6,8 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "execmap.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -173,10 +175,84 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  mycpu()->gdt[SEG_UTLS] = SEG(STA_W, p->tlsbase, TLSSIZE - 1, DPL_USER);
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
+// Switch TSS and TLS segment to another lwp of the same process.
+// The page table is shared, so cr3 is left alone.
+// %gs picks up the new descriptor when trapret reloads it.
+void
+switchlwp(struct proc *p)
+{
+  if(p == 0)
+    panic("switchlwp: no process");
+  if(p->kstack == 0)
+    panic("switchlwp: no kstack");
+
+  pushcli();
+  mycpu()->ts.ss0 = SEG_KDATA << 3;
+  mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  mycpu()->gdt[SEG_UTLS] = SEG(STA_W, p->tlsbase, TLSSIZE - 1, DPL_USER);
+  popcli();
+}
+
+// Flush the tlb for the other cpus that asked for it.
+// Runs on T_TLBFLUSH, and while waiting in shootdown().
+void
+tlbintr(void)
+{
+  struct cpu *c;
+  uint req;
+
+  pushcli();
+  c = mycpu();
+  req = c->tlbreq;
+  if(c->tlback != req){
+    lcr3(rcr3());
+    c->tlback = req;
+  }
+  popcli();
+}
+
+// Make every cpu drop the translations of pgdir it may have cached,
+// after mappings were taken away or moved to another page. Lwps of
+// one process can run on several cpus at once.
+// Waits until the others have flushed, unless the caller holds a
+// spinlock that a cpu might be spinning for with interrupts off.
+void
+shootdown(pde_t *pgdir)
+{
+  struct cpu *c, *me;
+  struct proc *p;
+  uint want[NCPU];
+  int wait;
+
+  pushcli();
+  me = mycpu();
+  wait = me->ncli == 1;
+  if(pgdir == (pde_t*)P2V(rcr3()))
+    lcr3(V2P(pgdir));
+  __sync_synchronize();
+
+  for(c = cpus; c < cpus+ncpu; c++){
+    want[c-cpus] = 0;
+    if(c == me || (p = c->proc) == 0 || p->pgdir != pgdir)
+      continue;
+    want[c-cpus] = __sync_add_and_fetch(&c->tlbreq, 1);
+    lapicipi(c->apicid, T_TLBFLUSH);
+  }
+
+  // Flush for others meanwhile, they may be waiting for us.
+  for(c = cpus; wait && c < cpus+ncpu; c++)
+    while(want[c-cpus] != 0 && (int)(c->tlback - want[c-cpus]) < 0){
+      tlbintr();
+      pause();
+    }
+  popcli();
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -274,6 +350,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       kfree(v);
       *pte = 0;
     }
+    else
+      *pte = 0; // never touched page or guard page
   }
   return newsz;
 }
@@ -297,17 +375,162 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
-// Clear PTE_U on a page. Used to create an inaccessible
-// page beneath the user stack.
-void
-clearpteu(pde_t *pgdir, char *uva)
+// Mark a page as a guard page beneath a user stack.
+// It stays unmapped, and user accesses to it are never
+// faulted in. Returns 0 on success, -1 if out of memory.
+int
+setguard(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
 
-  pte = walkpgdir(pgdir, uva, 0);
-  if(pte == 0)
-    panic("clearpteu");
-  *pte &= ~PTE_U;
+  if((pte = walkpgdir(pgdir, uva, 1)) == 0)
+    return -1;
+  if(*pte & PTE_P)
+    panic("setguard: page is mapped");
+  *pte = PTE_GUARD;
+  return 0;
+}
+
+// Give pgdir a private, writable copy of the shared
+// copy-on-write page that pte maps.
+// Returns 1 if the page was copied, and other lwps must stop
+// reading the shared one, 0 if it was taken over, -1 if out of memory.
+static int
+unshare(pde_t *pgdir, pte_t *pte)
+{
+  char *v, *mem;
+
+  v = P2V(PTE_ADDR(*pte));
+  if(krefs(v) == 1){
+    // Nobody else maps it any more, take it over.
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    if(pgdir == (pde_t*)P2V(rcr3()))
+      lcr3(V2P(pgdir));   // flush the read-only translation
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, v, PGSIZE);
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  kfree(v);
+  return 1;
+}
+
+// Map a zeroed page at user address va that only the kernel can
+// access, unless something is mapped there already.
+// Returns 0, or -1 if out of memory.
+int
+mapscratch(pde_t *pgdir, uint va)
+{
+  struct spinlock *lk;
+  pte_t *pte;
+  char *mem;
+  int r;
+
+  lk = pgdirlock(pgdir);
+  if(lk)
+    acquire(lk);
+  r = -1;
+  if((pte = walkpgdir(pgdir, (char*)PGROUNDDOWN(va), 1)) != 0){
+    if(*pte & PTE_P)
+      r = 0;
+    else if((mem = kalloc()) != 0){
+      memset(mem, 0, PGSIZE);
+      *pte = V2P(mem) | PTE_W | PTE_P;
+      r = 0;
+    }
+  }
+  if(lk)
+    release(lk);
+  return r;
+}
+
+// Make user address va accessible, for writing if write is set.
+// If nothing is mapped yet, pages of the program's segments in map
+// (may be 0) come from the program file, all others are demand-zero:
+// exec(), sbrk() and thread stacks only grow sz, and the page is
+// allocated on first touch. Writing a shared copy-on-write page
+// gives pgdir its own copy.
+// A guard page is only mapped for the kernel (kernel != 0), and
+// without PTE_U, so system calls can copy into it as they could
+// when guard pages were allocated eagerly.
+// Lwps of one process fault on several cpus at once, so *pte is
+// only looked at and changed holding pgdirlock(pgdir). The file
+// is read without it, and *pte looked at again afterwards.
+// Returns 0 if va is accessible now, -1 if it can't be.
+int
+faultin(pde_t *pgdir, struct ExecMap *map, uint va, int write, int kernel)
+{
+  struct spinlock *lk;
+  pte_t *pte;
+  char *mem;
+  int perm, r, read;
+
+  va = PGROUNDDOWN(va);
+  if(va >= KERNBASE)
+    return -1;
+  lk = pgdirlock(pgdir);
+  read = 0;   // 1 once GetExecPage was asked, r is its answer
+  r = 0;
+
+again:
+  if(lk)
+    acquire(lk);
+  if((pte = walkpgdir(pgdir, (char*)va, 1)) == 0)
+    goto bad;
+  if(*pte & PTE_P){
+    // Another lwp may have faulted the page in while the file was read.
+    if(r == 1)
+      kfree(mem);
+    if(!kernel && !(*pte & PTE_U))
+      goto bad;   // guard page mapped for the kernel
+    if(!write || (*pte & PTE_W))
+      goto good;
+    if(!(*pte & PTE_COW))
+      goto bad;   // read-only program page
+    r = unshare(pgdir, pte);
+    if(lk)
+      release(lk);
+    // Other lwps must not go on reading the shared page
+    if(r == 1)
+      shootdown(pgdir);
+    return r < 0 ? -1 : 0;
+  }
+  if((*pte & PTE_GUARD) && !kernel)
+    goto bad;
+
+  if(map && !read){
+    // Reading the file may sleep
+    if(lk)
+      release(lk);
+    if((r = GetExecPage(map, va, &mem, &perm)) < 0)
+      return -1;
+    read = 1;
+    goto again;
+  }
+  if(r == 0){
+    if((mem = kalloc()) == 0)
+      goto bad;
+    memset(mem, 0, PGSIZE);
+    perm = (*pte & PTE_GUARD) ? PTE_W : PTE_W|PTE_U;
+  } else
+    perm |= PTE_U;
+  *pte = V2P(mem) | perm | PTE_P;
+  if(lk)
+    release(lk);
+  if(write && !(perm & PTE_W))
+    return faultin(pgdir, map, va, write, kernel);
+  return 0;
+
+good:
+  if(lk)
+    release(lk);
+  return 0;
+
+bad:
+  if(lk)
+    release(lk);
+  return -1;
 }
 
 // Given a parent process's page table, create a copy
@@ -323,15 +546,24 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
+    // Demand-zero pages and trash addresses of deallocated
+    // thread stacks have no page, the child faults them in itself.
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
     if(!(*pte & PTE_P)) {
-	  // If process has trash address about deallocated thread's user stack
+      if((*pte & PTE_GUARD) && setguard(d, (char*)i) < 0)
+        goto bad;
 	  continue;
-	  //panic("copyuvm: page not present");
 	}
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if((flags & PTE_U) && !(flags & PTE_W)){
+      // Program page shared through the page cache, keep sharing it.
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+        goto bad;
+      kdup(P2V(pa));
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
@@ -355,7 +587,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -364,6 +596,9 @@ uva2ka(pde_t *pgdir, char *uva)
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
+// Untouched pages are faulted in on the way as demand-zero,
+// so it must not be used on untouched pages of the program's
+// segments. Shared pages are copied before they are written.
 // uva2ka ensures this only works for PTE_U pages.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
@@ -374,6 +609,8 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    if(faultin(pgdir, 0, va0, 1, 0) < 0)
+      return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
@@ -133,6 +133,45 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically set *addr to newval if it is old.
+// Returns the value *addr had, which is old on success.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "+a" (old), "+m" (*addr) :
+               "r" (newval) :
+               "cc");
+  return old;
+}
+
+// Atomically add inc to *addr, returning the old value
+static inline uint
+xadd(volatile uint *addr, uint inc)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (inc), "+m" (*addr) :
+               :
+               "cc");
+  return inc;
+}
+
+// Tell the cpu it is in a spin-wait loop
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Cycles since reset, from the time-stamp counter
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -147,6 +186,14 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().